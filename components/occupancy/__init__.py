@@ -0,0 +1,103 @@
+from typing import Dict
+
+import esphome.codegen as cg
+import esphome.config_validation as cv
+from esphome.components import binary_sensor, sensor
+from esphome.const import CONF_ICON, CONF_ID, CONF_MAX_VALUE
+
+from ..persisted_number import PERSISTED_NUMBER_SCHEMA, new_persisted_number
+from ..roode import Roode, CONF_ROODE_ID
+
+AUTO_LOAD = ["number", "persisted_number"]
+
+CONF_DOORS = "doors"
+CONF_INSIDE = "inside"
+CONF_OUTSIDE = "outside"
+CONF_PEOPLE_COUNTER = "people_counter"
+CONF_PRESENCE_SENSORS = "presence_sensors"
+CONF_RECONCILE_AFTER = "reconcile_after"
+CONF_REMOTE_COUNTER = "remote_counter"
+CONF_ROOMS = "rooms"
+
+occupancy_ns = cg.esphome_ns.namespace("occupancy")
+Occupancy = occupancy_ns.class_("Occupancy", cg.Component)
+Room = occupancy_ns.class_("Room")
+
+ROOM_SCHEMA = cv.Schema(
+    {
+        cv.Required(CONF_ID): cv.declare_id(Room),
+        cv.Required(CONF_PEOPLE_COUNTER): PERSISTED_NUMBER_SCHEMA.extend(
+            {
+                cv.Optional(CONF_ICON, default="mdi:account-group"): cv.icon,
+                cv.Optional(CONF_MAX_VALUE, default=50): cv.int_range(1, 255),
+            }
+        ),
+        cv.Optional(CONF_PRESENCE_SENSORS, default=[]): cv.ensure_list(
+            cv.use_id(binary_sensor.BinarySensor)
+        ),
+        cv.Optional(
+            CONF_RECONCILE_AFTER, default="15min"
+        ): cv.positive_time_period_milliseconds,
+    }
+)
+
+DOOR_SCHEMA = cv.All(
+    cv.Schema(
+        {
+            cv.Optional(CONF_ROODE_ID): cv.use_id(Roode),
+            cv.Optional(CONF_REMOTE_COUNTER): cv.use_id(sensor.Sensor),
+            cv.Optional(CONF_INSIDE): cv.use_id(Room),
+            cv.Optional(CONF_OUTSIDE): cv.use_id(Room),
+        }
+    ),
+    cv.has_exactly_one_key(CONF_ROODE_ID, CONF_REMOTE_COUNTER),
+    cv.has_at_least_one_key(CONF_INSIDE, CONF_OUTSIDE),
+)
+
+CONFIG_SCHEMA = cv.Schema(
+    {
+        cv.GenerateID(): cv.declare_id(Occupancy),
+        cv.Required(CONF_ROOMS): cv.All(cv.ensure_list(ROOM_SCHEMA), cv.Length(min=1)),
+        cv.Required(CONF_DOORS): cv.All(cv.ensure_list(DOOR_SCHEMA), cv.Length(min=1)),
+    }
+).extend(cv.COMPONENT_SCHEMA)
+
+
+async def to_code(config: Dict):
+    occupancy = cg.new_Pvariable(config[CONF_ID])
+    await cg.register_component(occupancy, config)
+    for room_config in config[CONF_ROOMS]:
+        await setup_room(room_config, occupancy)
+    for door_config in config[CONF_DOORS]:
+        await setup_door(door_config, occupancy)
+
+
+async def setup_room(config: Dict, occupancy: cg.Pvariable):
+    counter_config = config[CONF_PEOPLE_COUNTER]
+    counter = await new_persisted_number(
+        counter_config, min_value=0, step=1, max_value=counter_config[CONF_MAX_VALUE]
+    )
+    room = cg.new_Pvariable(config[CONF_ID], config[CONF_ID].id, counter)
+    for sensor_id in config[CONF_PRESENCE_SENSORS]:
+        presence = await cg.get_variable(sensor_id)
+        cg.add(room.add_presence_sensor(presence))
+    cg.add(room.set_reconcile_after(config[CONF_RECONCILE_AFTER]))
+    cg.add(occupancy.add_room(room))
+
+
+async def setup_door(config: Dict, occupancy: cg.Pvariable):
+    # null for anywhere not counted, e.g. outdoors
+    inside = cg.nullptr
+    if CONF_INSIDE in config:
+        inside = await cg.get_variable(config[CONF_INSIDE])
+    outside = cg.nullptr
+    if CONF_OUTSIDE in config:
+        outside = await cg.get_variable(config[CONF_OUTSIDE])
+    if CONF_ROODE_ID in config:
+        # only nodes with a Roode of their own need it compiled in
+        cg.add_define("USE_OCCUPANCY_ROODE")
+        roode = await cg.get_variable(config[CONF_ROODE_ID])
+        cg.add(occupancy.add_door(roode, inside, outside))
+    else:
+        counter = await cg.get_variable(config[CONF_REMOTE_COUNTER])
+        cg.add(occupancy.add_remote_door(counter, inside, outside))
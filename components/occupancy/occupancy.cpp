@@ -0,0 +1,128 @@
+#include "occupancy.h"
+
+namespace esphome {
+namespace occupancy {
+
+#ifdef USE_OCCUPANCY_ROODE
+void Occupancy::add_door(roode::Roode *roode, Room *inside, Room *outside) {
+  auto *door = new Door{inside, outside, NAN};  // NOLINT(cppcoreguidelines-owning-memory)
+  doors.push_back(door);
+  roode->add_on_crossing_callback([this, door](int direction) { this->cross(door, direction); });
+}
+#endif
+
+#ifdef USE_SENSOR
+void Occupancy::add_remote_door(sensor::Sensor *counter, Room *inside, Room *outside) {
+  auto *door = new Door{inside, outside, NAN};  // NOLINT(cppcoreguidelines-owning-memory)
+  doors.push_back(door);
+  remote_doors++;
+  counter->add_on_state_callback([this, door](float count) {
+    if (std::isnan(count)) {
+      // unavailable, the changes in the meantime are applied once it's back
+      return;
+    }
+    if (std::isnan(door->remote_count)) {
+      // the first count after boot is where we start from
+      door->remote_count = count;
+      return;
+    }
+    int delta = lroundf(count - door->remote_count);
+    door->remote_count = count;
+    if (delta != 0) {
+      this->cross(door, delta);
+    }
+  });
+}
+#endif
+
+void Occupancy::setup() {
+  uint32_t now = millis();
+  for (auto *room : rooms) {
+    room->last_activity_ms = now;
+  }
+}
+
+void Occupancy::dump_config() {
+  ESP_LOGCONFIG(TAG, "Occupancy:");
+  ESP_LOGCONFIG(TAG, "  Doors: %u (%u remote)", (unsigned) doors.size(), remote_doors);
+  for (auto *room : rooms) {
+    ESP_LOGCONFIG(TAG, "  Room %s: { count: %d, reconcile after: %ums }", room->name, room->get_count(),
+                  room->reconcile_after_ms);
+  }
+}
+
+/**
+ * Updates both rooms in one go, so nothing else (e.g. another door's callback or the API) runs in between and sees a
+ * person counted in both rooms or in neither.
+ */
+void Occupancy::cross(Door *door, int delta) {
+  Room *to = delta > 0 ? door->inside : door->outside;
+  Room *from = delta > 0 ? door->outside : door->inside;
+  int people = std::abs(delta);
+  if (to != nullptr) {
+    // the counter rejects anything above its maximum, only move as many as fit so nobody vanishes from the other room
+    int room_left = std::max((int) to->counter->traits.get_max_value() - to->get_count(), 0);
+    if (people > room_left) {
+      ESP_LOGW(TAG, "%s is full, only moving %d of %d people", to->name, room_left, people);
+      people = room_left;
+    }
+  }
+  int to_count = to != nullptr ? to->get_count() + people : 0;
+  // nobody can leave an empty room, it was counted wrong before
+  int from_count = from != nullptr ? std::max(from->get_count() - people, 0) : 0;
+
+  uint32_t now = millis();
+  for (auto *room : {to, from}) {
+    if (room == nullptr) {
+      continue;
+    }
+    room->last_activity_ms = now;
+    int count = room == to ? to_count : from_count;
+    if (count == room->get_count()) {
+      continue;
+    }
+    ESP_LOGI(TAG, "Updating %s: %d", room->name, count);
+    auto call = room->counter->make_call();
+    call.set_value(count);
+    call.perform();
+  }
+}
+
+void Occupancy::loop() {
+  uint32_t now = millis();
+  for (auto *room : rooms) {
+    reconcile(room, now);
+  }
+}
+
+/**
+ * Resets the count of a room which all presence sensors have reported as empty for long enough.
+ * A sensor without a state (not published yet, or unavailable) doesn't know whether the room is empty.
+ */
+void Occupancy::reconcile(Room *room, uint32_t now) {
+#ifdef USE_BINARY_SENSOR
+  if (room->reconcile_after_ms == 0 || room->presence_sensors.empty()) {
+    return;
+  }
+  for (auto *sensor : room->presence_sensors) {
+    if (!sensor->has_state() || sensor->state) {
+      room->last_activity_ms = now;
+      return;
+    }
+  }
+  if (now - room->last_activity_ms < room->reconcile_after_ms) {
+    return;
+  }
+  room->last_activity_ms = now;
+  if (room->get_count() != 0) {
+    ESP_LOGI(TAG, "%s has been empty for %ums, resetting the count of %d", room->name, room->reconcile_after_ms,
+             room->get_count());
+    auto call = room->counter->make_call();
+    call.set_value(0);
+    call.perform();
+  }
+#endif
+}
+
+}  // namespace occupancy
+}  // namespace esphome
@@ -0,0 +1,91 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "esphome/core/component.h"
+#include "esphome/core/defines.h"
+#include "esphome/core/hal.h"
+#include "esphome/core/log.h"
+#include "esphome/components/number/number.h"
+#ifdef USE_SENSOR
+#include "esphome/components/sensor/sensor.h"
+#endif
+#ifdef USE_BINARY_SENSOR
+#include "esphome/components/binary_sensor/binary_sensor.h"
+#endif
+#ifdef USE_OCCUPANCY_ROODE
+#include "../roode/roode.h"
+#endif
+
+namespace esphome {
+namespace occupancy {
+static const char *const TAG = "Occupancy";
+
+/** A room counted by the doors leading into it */
+class Room {
+ public:
+  Room(const char *name, number::Number *counter) : name(name), counter(counter) {}
+#ifdef USE_BINARY_SENSOR
+  void add_presence_sensor(binary_sensor::BinarySensor *sensor) { presence_sensors.push_back(sensor); }
+#endif
+  void set_reconcile_after(uint32_t reconcile_after_ms) { this->reconcile_after_ms = reconcile_after_ms; }
+  int get_count() const { return std::isnan(counter->state) ? 0 : (int) counter->state; }
+
+ protected:
+  friend class Occupancy;
+  const char *name;
+  number::Number *counter;
+#ifdef USE_BINARY_SENSOR
+  std::vector<binary_sensor::BinarySensor *> presence_sensors{};
+#endif
+  /** How long all presence sensors need to report empty before the count is reset, 0 to never reset it */
+  uint32_t reconcile_after_ms{0};
+  /** Last time the room was known to be in use: a presence sensor was on or a door counted somebody */
+  uint32_t last_activity_ms{0};
+};
+
+/** Connects two rooms, `outside` may be null for the outdoors or anywhere else that isn't counted */
+struct Door {
+  Room *inside;
+  Room *outside;
+  /** Last count of a remote door's people counter, NAN until it is known */
+  float remote_count;
+};
+
+/**
+ * Keeps the number of people per room from the entries & exits of the doors between them, e.g. for rooms with two doors
+ * or a hallway in between. An entry moves a person from the door's outside room to its inside room, an exit the other
+ * way around.
+ *
+ * Doors are either Roode instances on this node, or the people counter of a Roode on another node, imported through
+ * the native API as a Home Assistant sensor. For the latter, every change of the remote count is taken as that many
+ * crossings, including the ones made while the connection was down.
+ */
+class Occupancy : public Component {
+ public:
+  void setup() override;
+  void loop() override;
+  void dump_config() override;
+  float get_setup_priority() const override { return setup_priority::DATA; }
+  void add_room(Room *room) { rooms.push_back(room); }
+#ifdef USE_OCCUPANCY_ROODE
+  void add_door(roode::Roode *roode, Room *inside, Room *outside);
+#endif
+#ifdef USE_SENSOR
+  void add_remote_door(sensor::Sensor *counter, Room *inside, Room *outside);
+#endif
+
+ protected:
+  /** Moves `delta` people through the door, negative for exits */
+  void cross(Door *door, int delta);
+  void reconcile(Room *room, uint32_t now);
+
+  std::vector<Room *> rooms{};
+  /** Allocated once when configured, the callbacks keep pointers to them */
+  std::vector<Door *> doors{};
+  uint8_t remote_doors{0};
+};
+
+}  // namespace occupancy
+}  // namespace esphome
@@ -1,34 +1,89 @@
 from typing import Dict, Union
 import esphome.codegen as cg
 import esphome.config_validation as cv
+import esphome.final_validate as fv
+from esphome import automation
+from esphome.components import time as time_, uart
+from esphome.core import CORE
 from esphome.const import (
     CONF_HEIGHT,
     CONF_ID,
+    CONF_INTERRUPT,
+    CONF_INTERVAL,
     CONF_INVERT,
+    CONF_PINS,
+    CONF_PORT,
     CONF_SENSOR,
+    CONF_TIME_ID,
+    CONF_TRIGGER_ID,
+    CONF_UART_ID,
     CONF_WIDTH,
 )
 from ..vl53l1x import distance_as_mm, NullableSchema, VL53L1X
 
 DEPENDENCIES = ["vl53l1x"]
-AUTO_LOAD = ["vl53l1x", "sensor", "binary_sensor", "text_sensor", "number"]
 MULTI_CONF = True
 
+
+def AUTO_LOAD():
+    """Only a raw stream over TCP needs sockets, everybody else shouldn't have to build them."""
+    roodes = (CORE.raw_config or {}).get("roode") or []
+    for conf in roodes if isinstance(roodes, list) else [roodes]:
+        raw_stream = conf.get(CONF_RAW_STREAM) if isinstance(conf, dict) else None
+        if isinstance(raw_stream, dict) and CONF_PORT in raw_stream:
+            return ["vl53l1x", "socket"]
+    return ["vl53l1x"]
+
+
 CONF_ROODE_ID = "roode_id"
 
 roode_ns = cg.esphome_ns.namespace("roode")
 Roode = roode_ns.class_("Roode", cg.PollingComponent)
+EventLog = roode_ns.class_("EventLog")
+RawStream = roode_ns.class_("RawStream")
+RawStreamTransport = roode_ns.class_("RawStreamTransport")
+UartRawStreamTransport = roode_ns.class_("UartRawStreamTransport", RawStreamTransport)
+TcpRawStreamTransport = roode_ns.class_("TcpRawStreamTransport", RawStreamTransport)
+CrossingTrigger = roode_ns.class_(
+    "CrossingTrigger", automation.Trigger.template(cg.int_, cg.int_, cg.uint32, cg.uint8)
+)
 
+CONF_ACQUISITION_TASK = "acquisition_task"
+CONF_AFTER = "after"
 CONF_AUTO = "auto"
 CONF_ORIENTATION = "orientation"
 CONF_DETECTION_THRESHOLDS = "detection_thresholds"
+CONF_ENABLED = "enabled"
 CONF_ENTRY_ZONE = "entry"
+CONF_EVENT_LOG = "event_log"
 CONF_EXIT_ZONE = "exit"
+CONF_BIAS = "bias"
+CONF_CALIBRATION = "calibration"
 CONF_CENTER = "center"
+CONF_CLASSIFIER_MODEL = "classifier_model"
+CONF_FILTER = "filter"
+CONF_FLUSH_INTERVAL = "flush_interval"
+CONF_IDLE = "idle"
+CONF_LIGHT_SLEEP = "light_sleep"
 CONF_MAX = "max"
+CONF_MAX_CONSECUTIVE_READS = "max_consecutive_reads"
+CONF_MAX_RECORDS = "max_records"
+CONF_MAX_SAMPLES = "max_samples"
 CONF_MIN = "min"
+CONF_MIN_SAMPLES = "min_samples"
+CONF_ON_ENTRY = "on_entry"
+CONF_ON_EXIT = "on_exit"
+CONF_PACKET_SIZE = "packet_size"
+CONF_PERSIST_CALIBRATION = "persist_calibration"
+CONF_RAW_STREAM = "raw_stream"
 CONF_ROI = "roi"
 CONF_SAMPLING = "sampling"
+CONF_SCHEDULING = "scheduling"
+CONF_SHIFTS = "shifts"
+CONF_SPECULATIVE_EVENTS = "speculative_events"
+CONF_TOLERANCE = "tolerance"
+CONF_TRACKING = "tracking"
+CONF_TRANSPORT_ID = "transport_id"
 CONF_ZONES = "zones"
 
 Orientation = roode_ns.enum("Orientation")
@@ -37,8 +92,93 @@ ORIENTATION_VALUES = {
     "perpendicular": Orientation.Perpendicular,
 }
 
+FILTERS = {
+    "minimum": "MinimumFilter",
+    "median": "MedianFilter",
+}
+
+SCHEDULERS = ["alternate", "activity"]
+
+TRACKERS = ["path", "classifier"]
+# what on_entry & on_exit automations get, see CrossingTrigger in automation.h
+CROSSING_ARGS = [
+    (cg.int_, "direction"),
+    (cg.int_, "count"),
+    (cg.uint32, "timestamp"),
+    (cg.uint8, "confidence"),
+]
+CROSSING_DIRECTIONS = {CONF_ON_ENTRY: 1, CONF_ON_EXIT: -1}
+# see CrossingFeatures in classifier.h
+CLASSIFIER_FEATURES = 9
+
 roi_range = cv.int_range(min=4, max=16)
 
+
+def validate_acquisition_task(value):
+    value = cv.boolean(value)
+    if value and not CORE.is_esp32:
+        raise cv.Invalid("The acquisition task is only available on ESP32")
+    return value
+
+
+def validate_event_log(config):
+    if not CORE.is_esp32 or not CORE.using_arduino:
+        raise cv.Invalid("The event log is only available on ESP32 with the Arduino framework")
+    return config
+
+
+def validate_idle(config):
+    if CONF_LIGHT_SLEEP not in config.get(CONF_IDLE, {}):
+        return config
+    if not CORE.is_esp32:
+        raise cv.Invalid("Light sleep is only available on ESP32", path=[CONF_IDLE])
+    if config[CONF_ACQUISITION_TASK]:
+        raise cv.Invalid(
+            "Light sleep can't be used with the acquisition task", path=[CONF_IDLE]
+        )
+    return config
+
+
+def validate_calibration(config):
+    if config[CONF_MIN_SAMPLES] > config[CONF_MAX_SAMPLES]:
+        raise cv.Invalid(
+            "min_samples can't be more than max_samples", path=[CONF_MIN_SAMPLES]
+        )
+    return config
+
+
+def weights(validator):
+    return cv.All(
+        cv.ensure_list(validator),
+        cv.Length(min=CLASSIFIER_FEATURES, max=CLASSIFIER_FEATURES),
+    )
+
+
+CLASSIFIER_MODEL_SCHEMA = cv.Schema(
+    {
+        cv.Required(CONF_SHIFTS): weights(cv.int_range(min=0, max=15)),
+        cv.Required(CONF_ENTRY_ZONE): weights(cv.int_range(min=-32767, max=32767)),
+        cv.Required(CONF_EXIT_ZONE): weights(cv.int_range(min=-32767, max=32767)),
+        cv.Required(CONF_BIAS): cv.All(
+            cv.ensure_list(cv.int_range(min=-(2**31), max=2**31 - 1)),
+            cv.Length(min=2, max=2),
+        ),
+    }
+)
+
+
+def validate_tracking(config):
+    if config[CONF_TRACKING] == "classifier" and config[CONF_SPECULATIVE_EVENTS]:
+        raise cv.Invalid(
+            "speculative_events needs path tracking", path=[CONF_SPECULATIVE_EVENTS]
+        )
+    if CONF_CLASSIFIER_MODEL in config and config[CONF_TRACKING] != "classifier":
+        raise cv.Invalid(
+            "classifier_model needs classifier tracking", path=[CONF_CLASSIFIER_MODEL]
+        )
+    return config
+
+
 ROI_SCHEMA = cv.Any(
     NullableSchema(
         {
@@ -59,54 +199,259 @@ THRESHOLDS_SCHEMA = NullableSchema(
     }
 )
 
-ZONE_SCHEMA = NullableSchema(
+RAW_STREAM_SCHEMA = cv.All(
+    cv.Schema(
+        {
+            cv.GenerateID(): cv.declare_id(RawStream),
+            cv.GenerateID(CONF_TRANSPORT_ID): cv.declare_id(RawStreamTransport),
+            cv.Optional(CONF_UART_ID): cv.use_id(uart.UARTComponent),
+            cv.Optional(CONF_PORT): cv.port,
+            cv.Optional(CONF_ENABLED, default=False): cv.boolean,
+            cv.Optional(CONF_PACKET_SIZE, default=1460): cv.int_range(min=64, max=1460),
+            cv.Optional(
+                CONF_FLUSH_INTERVAL, default="100ms"
+            ): cv.positive_time_period_milliseconds,
+        }
+    ),
+    cv.has_exactly_one_key(CONF_UART_ID, CONF_PORT),
+)
+
+EVENT_LOG_SCHEMA = cv.All(
+    cv.Schema(
+        {
+            cv.GenerateID(): cv.declare_id(EventLog),
+            cv.Optional(CONF_TIME_ID): cv.use_id(time_.RealTimeClock),
+            cv.Optional(CONF_MAX_RECORDS, default=4096): cv.int_range(min=32, max=65536),
+            cv.Optional(
+                CONF_FLUSH_INTERVAL, default="60s"
+            ): cv.positive_time_period_milliseconds,
+        }
+    ),
+    validate_event_log,
+)
+
+CALIBRATION_SCHEMA = cv.All(
+    cv.Schema(
+        {
+            cv.Optional(CONF_TOLERANCE, default="10mm"): cv.All(
+                distance_as_mm, cv.int_range(min=1, max=1000)
+            ),
+            cv.Optional(CONF_MIN_SAMPLES, default=8): cv.int_range(min=2, max=1000),
+            cv.Optional(CONF_MAX_SAMPLES, default=60): cv.int_range(min=2, max=1000),
+        }
+    ),
+    validate_calibration,
+)
+
+IDLE_SCHEMA = cv.Schema(
     {
-        cv.Optional(CONF_ROI, default={}): ROI_SCHEMA,
-        cv.Optional(CONF_DETECTION_THRESHOLDS, default={}): THRESHOLDS_SCHEMA,
+        cv.Optional(CONF_AFTER, default="30s"): cv.positive_time_period_milliseconds,
+        cv.Optional(CONF_INTERVAL): cv.positive_time_period_milliseconds,
+        cv.Optional(CONF_LIGHT_SLEEP): cv.positive_time_period_milliseconds,
     }
 )
 
-CONFIG_SCHEMA = cv.Schema(
+ZONE_SCHEMA = NullableSchema(
     {
-        cv.GenerateID(): cv.declare_id(Roode),
-        cv.GenerateID(CONF_SENSOR): cv.use_id(VL53L1X),
-        cv.Optional(CONF_ORIENTATION, default="parallel"): cv.enum(ORIENTATION_VALUES),
-        cv.Optional(CONF_SAMPLING, default=2): cv.All(cv.uint8_t, cv.Range(min=1)),
         cv.Optional(CONF_ROI, default={}): ROI_SCHEMA,
         cv.Optional(CONF_DETECTION_THRESHOLDS, default={}): THRESHOLDS_SCHEMA,
-        cv.Optional(CONF_ZONES, default={}): NullableSchema(
-            {
-                cv.Optional(CONF_INVERT, default=False): cv.boolean,
-                cv.Optional(CONF_ENTRY_ZONE, default={}): ZONE_SCHEMA,
-                cv.Optional(CONF_EXIT_ZONE, default={}): ZONE_SCHEMA,
-            }
-        ),
     }
-).extend(cv.COMPONENT_SCHEMA)
+)
+
+CONFIG_SCHEMA = cv.All(
+    cv.Schema(
+        {
+            cv.GenerateID(): cv.declare_id(Roode),
+            cv.GenerateID(CONF_SENSOR): cv.use_id(VL53L1X),
+            cv.Optional(CONF_ORIENTATION, default="parallel"): cv.enum(ORIENTATION_VALUES),
+            cv.Optional(CONF_SAMPLING, default=2): cv.All(cv.uint8_t, cv.Range(min=1)),
+            cv.Optional(CONF_FILTER, default="minimum"): cv.one_of(*FILTERS, lower=True),
+            cv.Optional(CONF_SCHEDULING, default="alternate"): cv.one_of(
+                *SCHEDULERS, lower=True
+            ),
+            cv.Optional(CONF_MAX_CONSECUTIVE_READS, default=2): cv.int_range(min=2, max=8),
+            cv.Optional(CONF_PERSIST_CALIBRATION, default=True): cv.boolean,
+            cv.Optional(CONF_CALIBRATION, default={}): CALIBRATION_SCHEMA,
+            cv.Optional(CONF_SPECULATIVE_EVENTS, default=False): cv.boolean,
+            cv.Optional(CONF_TRACKING, default="path"): cv.one_of(*TRACKERS, lower=True),
+            cv.Optional(CONF_CLASSIFIER_MODEL): CLASSIFIER_MODEL_SCHEMA,
+            cv.Optional(CONF_ACQUISITION_TASK, default=False): validate_acquisition_task,
+            cv.Optional(CONF_RAW_STREAM): RAW_STREAM_SCHEMA,
+            cv.Optional(CONF_EVENT_LOG): EVENT_LOG_SCHEMA,
+            cv.Optional(CONF_IDLE): IDLE_SCHEMA,
+            cv.Optional(CONF_ON_ENTRY): automation.validate_automation(
+                {cv.GenerateID(CONF_TRIGGER_ID): cv.declare_id(CrossingTrigger)}
+            ),
+            cv.Optional(CONF_ON_EXIT): automation.validate_automation(
+                {cv.GenerateID(CONF_TRIGGER_ID): cv.declare_id(CrossingTrigger)}
+            ),
+            cv.Optional(CONF_ROI, default={}): ROI_SCHEMA,
+            cv.Optional(CONF_DETECTION_THRESHOLDS, default={}): THRESHOLDS_SCHEMA,
+            cv.Optional(CONF_ZONES, default={}): NullableSchema(
+                {
+                    cv.Optional(CONF_INVERT, default=False): cv.boolean,
+                    cv.Optional(CONF_ENTRY_ZONE, default={}): ZONE_SCHEMA,
+                    cv.Optional(CONF_EXIT_ZONE, default={}): ZONE_SCHEMA,
+                }
+            ),
+        }
+    ).extend(cv.COMPONENT_SCHEMA),
+    validate_tracking,
+    validate_idle,
+)
+
+
+def validate_pipeline(config):
+    """The pipeline is picked at compile time, so all Roode instances have to agree on it."""
+    for other in fv.full_config.get()["roode"]:
+        for key in (
+            CONF_FILTER,
+            CONF_SPECULATIVE_EVENTS,
+            CONF_TRACKING,
+            CONF_CLASSIFIER_MODEL,
+            CONF_SCHEDULING,
+            CONF_MAX_CONSECUTIVE_READS,
+        ):
+            if other.get(key) != config.get(key):
+                raise cv.Invalid(f"All roode instances must use the same {key}", path=[key])
+    return config
+
+
+def validate_light_sleep(config):
+    """Waking up from light sleep takes the sensor's interrupt pin."""
+    if CONF_LIGHT_SLEEP not in config.get(CONF_IDLE, {}):
+        return config
+    if CONF_INTERRUPT not in fv.full_config.get()["vl53l1x"][CONF_PINS]:
+        raise cv.Invalid(
+            "Light sleep needs the interrupt pin of the vl53l1x", path=[CONF_IDLE]
+        )
+    return config
+
+
+FINAL_VALIDATE_SCHEMA = cv.All(validate_pipeline, validate_light_sleep)
 
 
 async def to_code(config: Dict):
     roode = cg.new_Pvariable(config[CONF_ID])
     await cg.register_component(roode, config)
+    setup_pipeline(config)
 
     sens = await cg.get_variable(config[CONF_SENSOR])
     cg.add(roode.set_tof_sensor(sens))
 
     cg.add(roode.set_orientation(config[CONF_ORIENTATION]))
     cg.add(roode.set_sampling_size(config[CONF_SAMPLING]))
+    cg.add(roode.set_persist_calibration(config[CONF_PERSIST_CALIBRATION]))
+    cg.add(roode.set_object_id(config[CONF_ID].id))
+    setup_calibration(config[CONF_CALIBRATION], roode)
+    if config[CONF_ACQUISITION_TASK]:
+        cg.add_define("USE_ROODE_ACQUISITION_TASK")
+        cg.add(roode.set_acquisition_task(True))
     cg.add(roode.set_invert_direction(config[CONF_ZONES][CONF_INVERT]))
     setup_zone(CONF_ENTRY_ZONE, config, roode)
     setup_zone(CONF_EXIT_ZONE, config, roode)
+    if CONF_RAW_STREAM in config:
+        await setup_raw_stream(config[CONF_RAW_STREAM], roode)
+    if CONF_EVENT_LOG in config:
+        await setup_event_log(config[CONF_EVENT_LOG], roode)
+    if CONF_IDLE in config:
+        setup_idle(config[CONF_IDLE], roode)
+    for key, direction in CROSSING_DIRECTIONS.items():
+        for conf in config.get(key, []):
+            trigger = cg.new_Pvariable(conf[CONF_TRIGGER_ID], roode, direction)
+            await automation.build_automation(trigger, CROSSING_ARGS, conf)
+
+
+def setup_pipeline(config: Dict):
+    """Picks the pipeline stages (see pipeline.h), the ones not picked aren't compiled in."""
+    filter_class = FILTERS[config[CONF_FILTER]]
+    # the sampling size is set per instance, the filter only needs room for the largest one
+    capacity = max(conf[CONF_SAMPLING] for conf in CORE.config["roode"])
+    cg.add_define("ROODE_FILTER", cg.RawExpression(f"{filter_class}<{capacity}>"))
+    cg.add_define("ROODE_DETECTOR", cg.RawExpression("ThresholdDetector"))
+    if config[CONF_TRACKING] == "classifier":
+        cg.add_define("ROODE_TRACKER", cg.RawExpression("ClassifyingTracker"))
+        if CONF_CLASSIFIER_MODEL in config:
+            model = config[CONF_CLASSIFIER_MODEL]
+            lists = ", ".join(
+                "{" + ", ".join(str(value) for value in model[key]) + "}"
+                for key in (CONF_SHIFTS, CONF_ENTRY_ZONE, CONF_EXIT_ZONE)
+            )
+            entry_bias, exit_bias = model[CONF_BIAS]
+            cg.add_define(
+                "ROODE_CROSSING_MODEL",
+                cg.RawExpression(f"{{{lists}, {entry_bias}, {exit_bias}}}"),
+            )
+    else:
+        speculative = "true" if config[CONF_SPECULATIVE_EVENTS] else "false"
+        cg.add_define("ROODE_TRACKER", cg.RawExpression(f"PathTracker<{speculative}>"))
+    if config[CONF_SCHEDULING] == "activity":
+        max_reads = config[CONF_MAX_CONSECUTIVE_READS]
+        cg.add_define("ROODE_SCHEDULER", cg.RawExpression(f"ActivityScheduler<{max_reads}>"))
+    else:
+        cg.add_define("ROODE_SCHEDULER", cg.RawExpression("AlternatingScheduler"))
+
+
+async def setup_raw_stream(config: Dict, roode: cg.Pvariable):
+    if CONF_UART_ID in config:
+        cg.add_define("USE_ROODE_RAW_STREAM_UART")
+        uart_bus = await cg.get_variable(config[CONF_UART_ID])
+        transport = cg.Pvariable(
+            config[CONF_TRANSPORT_ID],
+            UartRawStreamTransport.new(uart_bus),
+            UartRawStreamTransport,
+        )
+    else:
+        cg.add_define("USE_ROODE_RAW_STREAM_TCP")
+        transport = cg.Pvariable(
+            config[CONF_TRANSPORT_ID],
+            TcpRawStreamTransport.new(config[CONF_PORT]),
+            TcpRawStreamTransport,
+        )
+    stream = cg.new_Pvariable(config[CONF_ID], transport)
+    cg.add(stream.set_packet_size(config[CONF_PACKET_SIZE]))
+    cg.add(stream.set_flush_interval(config[CONF_FLUSH_INTERVAL]))
+    cg.add(stream.set_enabled(config[CONF_ENABLED]))
+    cg.add(roode.set_raw_stream(stream))
+
+
+async def setup_event_log(config: Dict, roode: cg.Pvariable):
+    cg.add_define("USE_ROODE_EVENT_LOG")
+    cg.add_library("FS", None)
+    cg.add_library("LittleFS", None)
+    # LittleFS.begin() mounts the partition at /littlefs
+    log = cg.new_Pvariable(config[CONF_ID], f"/littlefs/{config[CONF_ID].id}_")
+    cg.add(log.set_max_records(config[CONF_MAX_RECORDS]))
+    cg.add(log.set_flush_interval(config[CONF_FLUSH_INTERVAL]))
+    if CONF_TIME_ID in config:
+        clock = await cg.get_variable(config[CONF_TIME_ID])
+        cg.add(log.set_time(clock))
+    cg.add(roode.set_event_log(log))
+
+
+def setup_calibration(config: Dict, roode: cg.Pvariable):
+    sampling_var = cg.MockObj(f"{roode}->calibration_sampling", ".")
+    cg.add(sampling_var.set_tolerance(config[CONF_TOLERANCE]))
+    cg.add(sampling_var.set_min_samples(config[CONF_MIN_SAMPLES]))
+    cg.add(sampling_var.set_max_samples(config[CONF_MAX_SAMPLES]))
+
+
+def setup_idle(config: Dict, roode: cg.Pvariable):
+    cg.add(roode.set_idle_after(config[CONF_AFTER]))
+    if CONF_INTERVAL in config:
+        cg.add(roode.set_idle_interval(config[CONF_INTERVAL]))
+    if CONF_LIGHT_SLEEP in config:
+        cg.add(roode.set_light_sleep(config[CONF_LIGHT_SLEEP]))
 
 
 def setup_zone(name: str, config: Dict, roode: cg.Pvariable):
     zone_config = config[CONF_ZONES][name]
-    zone_var = cg.MockObj(f"{roode}->{name}", "->")
+    zone_var = cg.MockObj(f"{roode}->{name}", ".")
 
-    roi_var = cg.MockObj(f"{zone_var}->roi_override", "->")
+    roi_var = cg.MockObj(f"{zone_var}.roi_override", ".")
     setup_roi(roi_var, zone_config.get(CONF_ROI, {}), config.get(CONF_ROI, {}))
 
-    threshold_var = cg.MockObj(f"{zone_var}->threshold", "->")
+    threshold_var = cg.MockObj(f"{zone_var}.threshold", ".")
     setup_thresholds(
         threshold_var,
         zone_config.get(CONF_DETECTION_THRESHOLDS, {}),
@@ -0,0 +1,82 @@
+#include "acquisition_task.h"
+#ifdef USE_ESP32
+#include <esp_task_wdt.h>
+#endif
+
+namespace esphome {
+namespace roode {
+
+bool AcquisitionTask::start() {
+  if (running.load()) {
+    return true;
+  }
+  running = true;
+  stopped = false;
+#if defined(USE_ESP32)
+#if portNUM_PROCESSORS > 1
+  BaseType_t core = 1 - xPortGetCoreID();
+#else
+  BaseType_t core = tskNO_AFFINITY;
+#endif
+  // One above the main loop, so readings aren't delayed by anything else on that core except WiFi
+  if (xTaskCreatePinnedToCore(run, "roode", 4096, this, 2, nullptr, core) != pdPASS) {
+    ESP_LOGE(ACQUISITION, "Could not create task");
+    running = false;
+    stopped = true;
+    return false;
+  }
+  ESP_LOGI(ACQUISITION, "Started on core %d", core);
+  return true;
+#elif defined(USE_HOST)
+  thread = std::thread(run, this);
+  return true;
+#else
+  ESP_LOGE(ACQUISITION, "Not supported on this platform");
+  running = false;
+  stopped = true;
+  return false;
+#endif
+}
+
+void AcquisitionTask::stop() {
+  if (!running.load()) {
+    return;
+  }
+  running = false;
+#if defined(USE_HOST)
+  thread.join();
+#else
+  while (!stopped.load()) {
+    delay(1);
+  }
+#endif
+  ESP_LOGI(ACQUISITION, "Stopped");
+}
+
+void AcquisitionTask::feed_wdt() {
+#ifdef USE_ESP32
+  esp_task_wdt_reset();
+#endif
+}
+
+void AcquisitionTask::run(void *self) {
+  auto *task = static_cast<AcquisitionTask *>(self);
+#ifdef USE_ESP32
+  // Fed on every iteration, and by the sensor while the body waits for it
+  esp_task_wdt_add(nullptr);
+#endif
+  while (task->running.load()) {
+    feed_wdt();
+    task->body(task->arg);
+  }
+#ifdef USE_ESP32
+  esp_task_wdt_delete(nullptr);
+  task->stopped = true;
+  vTaskDelete(nullptr);
+#else
+  task->stopped = true;
+#endif
+}
+
+}  // namespace roode
+}  // namespace esphome
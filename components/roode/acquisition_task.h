@@ -0,0 +1,45 @@
+#pragma once
+#include <atomic>
+
+#include "esphome/core/hal.h"
+#include "esphome/core/log.h"
+#if defined(USE_ESP32)
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#elif defined(USE_HOST)
+#include <thread>
+#endif
+
+namespace esphome {
+namespace roode {
+static const char *const ACQUISITION = "Acquisition task";
+
+/**
+ * Runs a function over and over in a task of its own, pinned to the core the main loop doesn't run on.
+ * This is supported on ESP32, and on the host build with a std::thread so the hand-over can be exercised off-device.
+ */
+class AcquisitionTask {
+ public:
+  using Body = void (*)(void *arg);
+  AcquisitionTask(Body body, void *arg) : body(body), arg(arg) {}
+  /** Returns false if the platform has no tasks or creating the task failed */
+  bool start();
+  /** Returns once the body finished its last iteration */
+  void stop();
+  bool is_running() const { return running.load(); }
+  /** Called from the task while it waits, App.feed_wdt() is only meant for the main loop */
+  static void feed_wdt();
+
+ protected:
+  static void run(void *self);
+  Body body;
+  void *arg;
+  std::atomic<bool> running{false};
+  std::atomic<bool> stopped{true};
+#if defined(USE_HOST)
+  std::thread thread{};
+#endif
+};
+
+}  // namespace roode
+}  // namespace esphome
@@ -0,0 +1,24 @@
+#pragma once
+#include "esphome/core/automation.h"
+#include "roode.h"
+
+namespace esphome {
+namespace roode {
+
+/**
+ * Fires for the crossings in one direction, with the direction, the people count after the crossing, when it happened
+ * (ms since boot) and the confidence in percent. Dispatching only copies these, nothing is allocated.
+ */
+class CrossingTrigger : public Trigger<int, int, uint32_t, uint8_t> {
+ public:
+  CrossingTrigger(Roode *parent, int8_t direction) {
+    parent->add_on_crossing_event_callback([this, direction](const CrossingEvent &event) {
+      if (event.direction == direction) {
+        this->trigger(event.direction, event.count, event.timestamp_ms, event.confidence);
+      }
+    });
+  }
+};
+
+}  // namespace roode
+}  // namespace esphome
@@ -0,0 +1,219 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstdlib>
+
+namespace esphome {
+namespace roode {
+
+/** How both zones were occupied while somebody was below the sensor, in ms & mm. Left is the entry zone. */
+struct CrossingFeatures {
+  enum Index : uint8_t {
+    /** Time each zone was occupied */
+    DWELL_LEFT,
+    DWELL_RIGHT,
+    /** When the right zone got occupied first, relative to the left one, 0 unless both were */
+    ON_DELTA,
+    /** When the right zone was left last, relative to the left one, 0 unless both were occupied */
+    OFF_DELTA,
+    /** Time both zones were occupied at once */
+    OVERLAP,
+    /** How far the closest reading was below the floor (or whatever the empty zones see), e.g. low for pets */
+    DEPTH,
+    /** 100000 / the time both transitions between the zones took in ms, 0 unless both zones were occupied */
+    SPEED,
+    /**
+     * The smaller of ON_DELTA & OFF_DELTA if they agree on the direction, 0 otherwise. Whoever turned around in the
+     * zones entered & left on the same side, which a linear model can't tell from the two deltas alone.
+     */
+    CONSISTENCY,
+    /** 1000 if the zones were occupied in the order of an entry (right, both, left), -1000 for an exit, 0 otherwise */
+    PATH,
+    COUNT,
+  };
+  std::array<int16_t, COUNT> values{};
+};
+
+/**
+ * Collects the features of an episode: everything from the first zone getting occupied to both being free again.
+ * Readings of the zones may come in any order & rate.
+ */
+class CrossingRecorder {
+ public:
+  /** Returns true once the episode is complete, `features()` then describes it until the next episode starts */
+  bool add(bool left, bool occupied, uint16_t distance, uint32_t now_ms);
+  bool is_active() const { return this->active; }
+  CrossingFeatures features() const;
+
+ protected:
+  bool active{false};
+  bool occupied[2] = {false, false};
+  bool seen[2] = {false, false};
+  uint32_t first_on_ms[2] = {0, 0};
+  uint32_t last_off_ms[2] = {0, 0};
+  uint32_t last_reading_ms[2] = {0, 0};
+  uint32_t last_any_ms{0};
+  uint32_t dwell_ms[2] = {0, 0};
+  uint32_t overlap_ms{0};
+  /** Which zones were occupied (left 1, right 2, both 3), after the first change only the latest one is kept */
+  uint8_t path[3] = {0, 0, 0};
+  uint8_t path_size{0};
+  /** Last reading of each zone while it was free */
+  uint16_t floor[2] = {0, 0};
+  uint16_t min_distance{UINT16_MAX};
+};
+
+/**
+ * Linear model deciding whether an episode was an entry, an exit or nothing to count, evaluated in fixed point.
+ * Each feature is shifted right first, to about ±1024 at most. Scores are in units of 1 / SCORE_ONE, doing nothing has
+ * a score of 0, so the highest score wins (multinomial logistic regression with "ignore" as the reference).
+ * Trained with the host tool in simulator/classifier, see "Crossing classifier" in the README.
+ */
+struct CrossingModel {
+  static const int32_t SCORE_ONE = 65536;
+  static const int16_t MAX_FEATURE = 1024;
+
+  std::array<uint8_t, CrossingFeatures::COUNT> shifts;
+  std::array<int16_t, CrossingFeatures::COUNT> entry;
+  std::array<int16_t, CrossingFeatures::COUNT> exit;
+  int32_t entry_bias;
+  int32_t exit_bias;
+};
+
+struct Classification {
+  /** 1 for an entry, -1 for an exit, 0 to ignore the episode */
+  int8_t direction;
+  /** How sure the model is, in percent, from 50 on */
+  uint8_t confidence;
+};
+
+inline bool CrossingRecorder::add(bool left, bool occupied, uint16_t distance, uint32_t now_ms) {
+  uint8_t zone = left ? 0 : 1;
+  if (!this->active) {
+    this->last_reading_ms[zone] = now_ms;
+    if (!occupied) {
+      this->floor[zone] = distance;
+      return false;
+    }
+    this->active = true;
+    for (uint8_t i = 0; i < 2; i++) {
+      this->seen[i] = false;
+      this->dwell_ms[i] = 0;
+      this->last_reading_ms[i] = now_ms;
+    }
+    this->overlap_ms = 0;
+    this->path_size = 0;
+    this->last_any_ms = now_ms;
+    this->min_distance = UINT16_MAX;
+  }
+
+  // the time since the previous reading counts towards what that reading saw
+  if (this->occupied[zone]) {
+    this->dwell_ms[zone] += now_ms - this->last_reading_ms[zone];
+  }
+  if (this->occupied[0] && this->occupied[1]) {
+    this->overlap_ms += now_ms - this->last_any_ms;
+  }
+  this->last_reading_ms[zone] = now_ms;
+  this->last_any_ms = now_ms;
+
+  if (occupied) {
+    if (!this->seen[zone]) {
+      this->seen[zone] = true;
+      this->first_on_ms[zone] = now_ms;
+    }
+    this->min_distance = std::min(this->min_distance, distance);
+  } else {
+    this->floor[zone] = distance;
+    if (this->occupied[zone]) {
+      this->last_off_ms[zone] = now_ms;
+    }
+  }
+  bool changed = this->occupied[zone] != occupied;
+  this->occupied[zone] = occupied;
+
+  uint8_t state = this->occupied[0] | (this->occupied[1] << 1);
+  if (state == 0) {
+    this->active = false;
+    return true;
+  }
+  if (changed) {
+    // like PathTracker, which keeps 3 states after the empty one
+    this->path_size = std::min<uint8_t>(this->path_size + 1, 3);
+    this->path[this->path_size - 1] = state;
+  }
+  return false;
+}
+
+/** The complete paths, a crossing needs to have passed through both zones at once */
+inline int8_t path_direction(const uint8_t *path, uint8_t size) {
+  if (size != 3) {
+    return 0;
+  }
+  if (path[0] == 2 && path[1] == 3 && path[2] == 1) {
+    return 1;
+  }
+  if (path[0] == 1 && path[1] == 3 && path[2] == 2) {
+    return -1;
+  }
+  return 0;
+}
+
+inline CrossingFeatures CrossingRecorder::features() const {
+  auto saturate = [](int32_t value) -> int16_t {
+    return std::max<int32_t>(-INT16_MAX, std::min<int32_t>(INT16_MAX, value));
+  };
+  CrossingFeatures features{};
+  auto &values = features.values;
+  values[CrossingFeatures::DWELL_LEFT] = saturate(this->dwell_ms[0]);
+  values[CrossingFeatures::DWELL_RIGHT] = saturate(this->dwell_ms[1]);
+  values[CrossingFeatures::OVERLAP] = saturate(this->overlap_ms);
+  int32_t floor = std::max(this->floor[0], this->floor[1]);
+  values[CrossingFeatures::DEPTH] = saturate(std::max<int32_t>(floor - this->min_distance, 0));
+  if (this->seen[0] && this->seen[1]) {
+    int32_t on_delta = (int32_t) (this->first_on_ms[1] - this->first_on_ms[0]);
+    int32_t off_delta = (int32_t) (this->last_off_ms[1] - this->last_off_ms[0]);
+    values[CrossingFeatures::ON_DELTA] = saturate(on_delta);
+    values[CrossingFeatures::OFF_DELTA] = saturate(off_delta);
+    values[CrossingFeatures::SPEED] = saturate(100000 / (std::abs(on_delta) + std::abs(off_delta) + 1));
+    if ((on_delta > 0 && off_delta > 0) || (on_delta < 0 && off_delta < 0)) {
+      int32_t smaller = std::min(std::abs(on_delta), std::abs(off_delta));
+      values[CrossingFeatures::CONSISTENCY] = saturate(on_delta > 0 ? smaller : -smaller);
+    }
+    values[CrossingFeatures::PATH] = 1000 * path_direction(this->path, this->path_size);
+  }
+  return features;
+}
+
+inline Classification classify(const CrossingModel &model, const CrossingFeatures &features) {
+  // a model with large weights & biases can score beyond 32 bits
+  int64_t entry = model.entry_bias;
+  int64_t exit = model.exit_bias;
+  for (uint8_t i = 0; i < CrossingFeatures::COUNT; i++) {
+    int32_t value = features.values[i] >> model.shifts[i];
+    value = std::max<int32_t>(-CrossingModel::MAX_FEATURE, std::min<int32_t>(CrossingModel::MAX_FEATURE, value));
+    entry += int64_t(model.entry[i]) * value;
+    exit += int64_t(model.exit[i]) * value;
+  }
+  // the winner's margin over the runner-up, as a two-way logistic (0.5 + margin / 4, clamped) in percent
+  int64_t best = std::max({entry, exit, int64_t(0)});
+  int64_t second = best == 0 ? std::max(entry, exit) : std::max(std::min(entry, exit), int64_t(0));
+  int64_t confidence = 50 + (best - second) * 25 / CrossingModel::SCORE_ONE;
+  Classification result{};
+  result.direction = best == 0 ? 0 : (entry >= exit ? 1 : -1);
+  result.confidence = std::min<int64_t>(confidence, 100);
+  return result;
+}
+
+#ifndef ROODE_CROSSING_MODEL
+// trained on 1600 simulated runs with 10% of people turning around and 20% pets, 2200mm mounting height, sampling 2
+#define ROODE_CROSSING_MODEL \
+  { \
+    {2, 2, 0, 0, 2, 2, 2, 0, 0}, {-30, -20, -832, -603, 41, 562, 533, -1176, 240}, \
+        {68, 32, 1124, 1021, 39, 635, 469, 1014, -217}, -476435, -526836 \
+  }
+#endif
+
+}  // namespace roode
+}  // namespace esphome
@@ -0,0 +1,231 @@
+#include "event_log.h"
+#include <cstddef>
+#if defined(USE_ESP32) && defined(USE_ROODE_EVENT_LOG)
+#include <LittleFS.h>
+#endif
+
+namespace esphome {
+namespace roode {
+
+uint8_t EventRecord::compute_checksum() const {
+  const auto *bytes = reinterpret_cast<const uint8_t *>(this);
+  uint8_t sum = 0;
+  for (size_t i = 0; i < offsetof(EventRecord, checksum); i++) {
+    sum += bytes[i];
+  }
+  return sum;
+}
+
+void EventLog::dump_config() const {
+  ESP_LOGCONFIG(EVENT_LOG, "  Event log: { records: %u of %u, next sequence: %u, flush interval: %ums }",
+                counts[0] + counts[1], segment_capacity * 2, next_sequence, flush_interval_ms);
+  if (failed) {
+    ESP_LOGCONFIG(EVENT_LOG, "    Could not access the file system");
+  }
+  if (dropped > 0) {
+    ESP_LOGCONFIG(EVENT_LOG, "    Dropped records: %u", dropped);
+  }
+}
+
+void EventLog::setup() {
+#if defined(USE_ESP32) && defined(USE_ROODE_EVENT_LOG)
+  // formats the partition on first use, it is mounted at /littlefs
+  if (!LittleFS.begin(true)) {
+    ESP_LOGE(EVENT_LOG, "Could not mount LittleFS");
+    failed = true;
+    return;
+  }
+#endif
+  uint32_t last[2] = {0, 0};
+  for (uint8_t segment = 0; segment < 2; segment++) {
+    counts[segment] = scan_segment(segment, last[segment]);
+  }
+  current = last[1] > last[0] ? 1 : 0;
+  next_sequence = std::max(last[0], last[1]) + 1;
+  ESP_LOGI(EVENT_LOG, "Found %u records, continuing at sequence %u", counts[0] + counts[1], next_sequence);
+#ifdef USE_API
+  register_service(&EventLog::on_fetch_events, "fetch_events", {"first_sequence", "last_sequence"});
+#endif
+}
+
+std::string EventLog::segment_path(uint8_t segment) const {
+  return path + to_string(segment) + ".bin";
+}
+
+uint32_t EventLog::scan_segment(uint8_t segment, uint32_t &last_sequence) const {
+  FILE *file = fopen(segment_path(segment).c_str(), "rb");
+  if (file == nullptr) {
+    return 0;
+  }
+  fseek(file, 0, SEEK_END);
+  // a partially written record at the end is overwritten by the next write
+  uint32_t count = ftell(file) / sizeof(EventRecord);
+  EventRecord record{};
+  for (uint32_t index = count; index > 0; index--) {
+    fseek(file, (index - 1) * sizeof(EventRecord), SEEK_SET);
+    if (fread(&record, sizeof(record), 1, file) == 1 && record.is_valid()) {
+      last_sequence = record.sequence;
+      break;
+    }
+  }
+  fclose(file);
+  return count;
+}
+
+void EventLog::add(int8_t direction, int16_t count, uint8_t confidence, bool retraction) {
+  EventRecord record{};
+  record.sequence = next_sequence++;
+  record.timestamp = millis() / 1000;
+  record.flags = EventRecord::UPTIME;
+#ifdef USE_TIME
+  if (clock != nullptr) {
+    auto now = clock->now();
+    if (now.is_valid()) {
+      record.timestamp = now.timestamp;
+      record.flags = 0;
+    }
+  }
+#endif
+  if (retraction) {
+    record.flags |= EventRecord::RETRACTION;
+  }
+  record.count = count;
+  record.direction = direction;
+  record.confidence = confidence;
+  record.checksum = record.compute_checksum();
+
+  if (buffered == 0) {
+    batch_started_ms = millis();
+  }
+  buffer[buffered++] = record;
+  if (buffered == BUFFER_SIZE) {
+    flush();
+  }
+}
+
+void EventLog::loop() {
+  if (buffered > 0 && millis() - batch_started_ms >= flush_interval_ms) {
+    flush();
+  }
+  if (fetching) {
+    fetch_next();
+  }
+}
+
+void EventLog::flush() {
+  if (buffered == 0) {
+    return;
+  }
+  if (failed) {
+    dropped += buffered;
+    buffered = 0;
+    return;
+  }
+  uint8_t written = 0;
+  while (written < buffered) {
+    if (counts[current] >= segment_capacity) {
+      // the current segment is full, the older one makes room and is truncated when opened below
+      current = 1 - current;
+      counts[current] = 0;
+    }
+    FILE *file = fopen(segment_path(current).c_str(), counts[current] == 0 ? "wb" : "r+b");
+    if (file == nullptr) {
+      ESP_LOGW(EVENT_LOG, "Could not open %s", segment_path(current).c_str());
+      break;
+    }
+    uint32_t batch = std::min<uint32_t>(buffered - written, segment_capacity - counts[current]);
+    fseek(file, counts[current] * sizeof(EventRecord), SEEK_SET);
+    uint32_t done = fwrite(buffer.data() + written, sizeof(EventRecord), batch, file);
+    fclose(file);
+    counts[current] += done;
+    written += done;
+    if (done < batch) {
+      ESP_LOGW(EVENT_LOG, "Could only write %u of %u records", done, batch);
+      break;
+    }
+  }
+  ESP_LOGD(EVENT_LOG, "Wrote %u records", written);
+  dropped += buffered - written;
+  buffered = 0;
+}
+
+void EventLog::fetch(uint32_t first, uint32_t last) {
+  // the buffered records are fetched as well
+  flush();
+  ESP_LOGI(EVENT_LOG, "Fetching records %u to %u", first, last);
+  fetching = true;
+  fetch_first = first;
+  fetch_last = last == 0 ? UINT32_MAX : last;
+  fetch_segment = 0;
+  fetch_index = 0;
+}
+
+/** Scans on from where the last call stopped, publishing the records in range */
+void EventLog::fetch_next() {
+  uint8_t published = 0;
+  uint8_t scanned = 0;
+  while (published < FETCH_BATCH && scanned < SCAN_BATCH) {
+    uint8_t segment = fetch_segment == 0 ? 1 - current : current;
+    if (fetch_index >= counts[segment]) {
+      if (fetch_segment == 1) {
+        ESP_LOGI(EVENT_LOG, "Finished fetching");
+        fetching = false;
+        return;
+      }
+      fetch_segment = 1;
+      fetch_index = 0;
+      continue;
+    }
+    FILE *file = fopen(segment_path(segment).c_str(), "rb");
+    if (file == nullptr) {
+      fetch_index = counts[segment];
+      continue;
+    }
+    std::array<EventRecord, 16> records{};
+    fseek(file, fetch_index * sizeof(EventRecord), SEEK_SET);
+    uint32_t count = fread(records.data(), sizeof(EventRecord),
+                           std::min<uint32_t>(records.size(), counts[segment] - fetch_index), file);
+    fclose(file);
+    if (count == 0) {
+      fetch_index = counts[segment];
+      continue;
+    }
+    for (uint32_t i = 0; i < count && published < FETCH_BATCH; i++) {
+      fetch_index++;
+      scanned++;
+      const auto &record = records[i];
+      if (record.is_valid() && record.sequence >= fetch_first && record.sequence <= fetch_last) {
+        publish(record);
+        published++;
+      }
+    }
+  }
+}
+
+void EventLog::publish(const EventRecord &record) {
+  ESP_LOGD(EVENT_LOG, "Record %u: { timestamp: %u%s, direction: %d%s, count: %d, confidence: %d%% }",
+           record.sequence, record.timestamp, record.flags & EventRecord::UPTIME ? " (uptime)" : "",
+           record.direction, record.flags & EventRecord::RETRACTION ? " (retraction)" : "", record.count,
+           record.confidence);
+#ifdef USE_API
+  fire_homeassistant_event("esphome.roode_crossing",
+                           {
+                               {"sequence", to_string(record.sequence)},
+                               {"timestamp", to_string(record.timestamp)},
+                               {"time_source", record.flags & EventRecord::UPTIME ? "uptime" : "clock"},
+                               {"direction", record.direction > 0 ? "entry" : "exit"},
+                               {"retraction", record.flags & EventRecord::RETRACTION ? "true" : "false"},
+                               {"count", to_string(record.count)},
+                               {"confidence", to_string(record.confidence)},
+                           });
+#endif
+}
+
+#ifdef USE_API
+void EventLog::on_fetch_events(int first_sequence, int last_sequence) {
+  fetch(std::max(first_sequence, 0), std::max(last_sequence, 0));
+}
+#endif
+
+}  // namespace roode
+}  // namespace esphome
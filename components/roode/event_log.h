@@ -0,0 +1,122 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <cstdio>
+#include <string>
+
+#include "esphome/core/defines.h"
+#include "esphome/core/hal.h"
+#include "esphome/core/helpers.h"
+#include "esphome/core/log.h"
+#ifdef USE_TIME
+#include "esphome/components/time/real_time_clock.h"
+#endif
+#ifdef USE_API
+#include "esphome/components/api/custom_api_device.h"
+#endif
+
+namespace esphome {
+namespace roode {
+static const char *const EVENT_LOG = "Event log";
+
+/** One logged crossing, stored as is (little endian) so a log file is an array of these */
+struct EventRecord {
+  enum Flags : uint8_t {
+    /** The timestamp is in seconds since boot, the time wasn't synchronized yet */
+    UPTIME = 1 << 0,
+    /** Undoes an earlier provisional crossing in `direction` */
+    RETRACTION = 1 << 1,
+  };
+  /** Increases by one per record, across reboots */
+  uint32_t sequence;
+  /** Unix time in seconds, or seconds since boot with the UPTIME flag */
+  uint32_t timestamp;
+  /** People count after the event */
+  int16_t count;
+  /** 1 for an entry, -1 for an exit */
+  int8_t direction;
+  /** In percent */
+  uint8_t confidence;
+  uint8_t flags;
+  uint8_t reserved[2];
+  /** Sum of all other bytes, to skip records torn by a power loss */
+  uint8_t checksum;
+
+  uint8_t compute_checksum() const;
+  bool is_valid() const { return this->sequence != 0 && this->checksum == this->compute_checksum(); }
+};
+static_assert(sizeof(EventRecord) == 16, "records are stored as is");
+
+/**
+ * Append-only log of crossings on flash, to backfill the history Home Assistant missed, e.g. while WiFi was down.
+ *
+ * Records are buffered in RAM and written in batches, once the buffer is full or the flush interval passed, to save
+ * flash writes. The log is split into two files of half the capacity each. Once the current one is full, the other one
+ * is emptied and written next, dropping the oldest half. Wear leveling is left to the file system (LittleFS).
+ *
+ * The `fetch_events` API service replays the records within a range of sequence numbers as `esphome.roode_crossing`
+ * events in Home Assistant, a few per loop iteration.
+ */
+class EventLog
+#ifdef USE_API
+    : public api::CustomAPIDevice
+#endif
+{
+ public:
+  static const uint8_t BUFFER_SIZE = 16;
+  /** Events fired per loop iteration while fetching */
+  static const uint8_t FETCH_BATCH = 8;
+  /** Records scanned per loop iteration while fetching */
+  static const uint8_t SCAN_BATCH = 64;
+
+  /** The segments are stored as `<path>0.bin` and `<path>1.bin` */
+  explicit EventLog(std::string path) : path(std::move(path)) {}
+  void set_max_records(uint32_t max_records) { segment_capacity = std::max<uint32_t>(1, max_records / 2); }
+  void set_flush_interval(uint32_t interval_ms) { flush_interval_ms = interval_ms; }
+#ifdef USE_TIME
+  void set_time(time::RealTimeClock *clock) { this->clock = clock; }
+#endif
+  void setup();
+  void loop();
+  void dump_config() const;
+  void add(int8_t direction, int16_t count, uint8_t confidence, bool retraction);
+  /** Writes the buffered records */
+  void flush();
+  /** Starts replaying the records with a sequence number from first to last, last 0 for all of them */
+  void fetch(uint32_t first, uint32_t last);
+
+ protected:
+  std::string segment_path(uint8_t segment) const;
+  /** Number of whole records in the segment and the sequence number of its last valid one */
+  uint32_t scan_segment(uint8_t segment, uint32_t &last_sequence) const;
+  void fetch_next();
+  void publish(const EventRecord &record);
+#ifdef USE_API
+  void on_fetch_events(int first_sequence, int last_sequence);
+#endif
+
+  std::string path;
+  bool failed{false};
+  uint32_t segment_capacity{2048};
+  uint32_t flush_interval_ms{60000};
+#ifdef USE_TIME
+  time::RealTimeClock *clock{nullptr};
+#endif
+  uint8_t current{0};
+  uint32_t counts[2] = {0, 0};
+  uint32_t next_sequence{1};
+  std::array<EventRecord, BUFFER_SIZE> buffer{};
+  uint8_t buffered{0};
+  uint32_t batch_started_ms{0};
+  uint32_t dropped{0};
+
+  bool fetching{false};
+  uint32_t fetch_first{0};
+  uint32_t fetch_last{0};
+  /** 0 for the older segment, 1 for the current one */
+  uint8_t fetch_segment{0};
+  uint32_t fetch_index{0};
+};
+
+}  // namespace roode
+}  // namespace esphome
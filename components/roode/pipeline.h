@@ -0,0 +1,324 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <cstdlib>
+
+#include "esphome/core/defines.h"
+#include "esphome/core/log.h"
+#include "classifier.h"
+
+/**
+ * The counting pipeline: every reading of a zone goes through a filter, the filtered distance through an occupancy
+ * detector, and the occupancy of both zones through a tracker, which hands crossings to the publisher (Roode::emit).
+ * A scheduler picks which zone is read next.
+ *
+ * The stages are picked at compile time by the codegen (see components/roode/__init__.py), so only the selected ones
+ * end up in the firmware. New stages only need to provide the same members as the ones below.
+ */
+
+namespace esphome {
+namespace roode {
+static const char *const TRACKING = "Roode pathTracking";
+
+/** What a tracker hands over for publishing */
+enum class TrackingEvent : uint8_t {
+  /** Someone entered (direction 1) or everybody left (direction 0) the zones */
+  Presence,
+  /** An entry (direction 1) or exit (direction -1) */
+  Crossing,
+  /** Undo a provisional crossing in direction */
+  Retraction,
+};
+
+/**
+ * Keeps the smallest of the last `size` readings, which smooths out readings missing a person's head.
+ * Capacity is fixed at compile time, the size can be lowered at runtime.
+ */
+template<uint8_t Capacity> class MinimumFilter {
+ public:
+  void set_size(uint8_t size) { this->size = std::max<uint8_t>(1, std::min(size, Capacity)); }
+  uint8_t get_size() const { return this->size; }
+  uint16_t update(uint16_t distance) {
+    this->window[this->next] = distance;
+    this->next = (this->next + 1) % this->size;
+    this->count = std::min<uint8_t>(this->count + 1, this->size);
+    return *std::min_element(this->window.begin(), this->window.begin() + this->count);
+  }
+  void reset() { this->next = this->count = 0; }
+
+ protected:
+  std::array<uint16_t, Capacity> window{};
+  uint8_t size{Capacity};
+  uint8_t next{0};
+  uint8_t count{0};
+};
+
+/** Keeps the median of the last `size` readings, which ignores single outliers in both directions */
+template<uint8_t Capacity> class MedianFilter : public MinimumFilter<Capacity> {
+ public:
+  uint16_t update(uint16_t distance) {
+    MinimumFilter<Capacity>::update(distance);
+    std::array<uint16_t, Capacity> sorted = this->window;
+    auto middle = sorted.begin() + this->count / 2;
+    std::nth_element(sorted.begin(), middle, sorted.begin() + this->count);
+    return *middle;
+  }
+};
+
+/** Someone is in a zone if the filtered distance is within the zone's detection thresholds */
+class ThresholdDetector {
+ public:
+  template<typename T> static bool is_occupied(uint16_t distance, const T &threshold) {
+    return distance < threshold.max && distance > threshold.min;
+  }
+};
+
+/**
+ * Turns the occupancy of the left & right zone into entries and exits, see "Algorithm" in the README.
+ * With `Speculative` an event is published as soon as the direction is clear (0 1 3 2 or 0 2 3 1), and confirmed or
+ * retracted once everybody left the zones.
+ *
+ * `publish(TrackingEvent, direction, confidence)` is called for everything that needs publishing, with the confidence
+ * in percent that a crossing really happened: 100 once the path is complete, 50 for a provisional event.
+ * Trackers get the filtered distance and the time of every reading as well, which this one doesn't need.
+ */
+template<bool Speculative> class PathTracker {
+ public:
+  template<typename Publish>
+  void update(bool left, bool occupied, uint16_t /*distance*/, uint32_t /*now_ms*/, Publish &&publish);
+
+ protected:
+  int direction() const;
+  int path_track[4] = {0, 0, 0, 0};
+  int path_track_filling_size = 1;  // init this to 1 as we start from state where nobody is any of the zones
+  bool left_previous_status = false;
+  bool right_previous_status = false;
+  bool presence = false;
+  /** Direction of a provisional event which still needs to be confirmed, 0 if there is none */
+  int pending_direction = 0;
+};
+
+template<bool Speculative>
+template<typename Publish>
+void PathTracker<Speculative>::update(bool left, bool occupied, uint16_t /*distance*/, uint32_t /*now_ms*/,
+                                      Publish &&publish) {
+  int AllZonesCurrentStatus = 0;
+  bool AnEventHasOccured = false;
+
+  if (occupied && !presence) {
+    presence = true;
+    publish(TrackingEvent::Presence, 1, 100);
+  }
+
+  // left zone
+  if (left) {
+    if (occupied != left_previous_status) {
+      // event in left zone has occured
+      AnEventHasOccured = true;
+
+      if (occupied) {
+        AllZonesCurrentStatus += 1;
+      }
+      // need to check right zone as well ...
+      if (right_previous_status) {
+        // event in right zone has occured
+        AllZonesCurrentStatus += 2;
+      }
+      // remember for next time
+      left_previous_status = occupied;
+    }
+  }
+  // right zone
+  else {
+    if (occupied != right_previous_status) {
+      // event in right zone has occured
+      AnEventHasOccured = true;
+      if (occupied) {
+        AllZonesCurrentStatus += 2;
+      }
+      // need to check left zone as well ...
+      if (left_previous_status) {
+        // event in left zone has occured
+        AllZonesCurrentStatus += 1;
+      }
+      // remember for next time
+      right_previous_status = occupied;
+    }
+  }
+
+  // if an event has occured
+  if (AnEventHasOccured) {
+    ESP_LOGD(TRACKING, "Event has occured, AllZonesCurrentStatus: %d", AllZonesCurrentStatus);
+    if (path_track_filling_size < 4) {
+      path_track_filling_size++;
+    }
+
+    // if nobody anywhere lets check if an exit or entry has happened
+    if (!left_previous_status && !right_previous_status) {
+      ESP_LOGD(TRACKING, "Nobody anywhere, AllZonesCurrentStatus: %d", AllZonesCurrentStatus);
+      // check exit or entry only if path_track_filling_size is 4 (for example 0 1
+      // 3 2) and last event is 0 (nobobdy anywhere)
+      int direction = this->direction();
+      if (direction != 0) {
+        ESP_LOGI(TRACKING, "%s detected.", direction > 0 ? "Entry" : "Exit");
+      }
+      if (pending_direction != 0 && pending_direction != direction) {
+        // The provisional event was not completed, e.g. the person turned around
+        ESP_LOGI(TRACKING, "Retracting provisional %s.", pending_direction > 0 ? "entry" : "exit");
+        publish(TrackingEvent::Retraction, pending_direction, 100);
+      } else if (pending_direction == 0 && direction != 0) {
+        publish(TrackingEvent::Crossing, direction, 100);
+      }
+
+      pending_direction = 0;
+      path_track_filling_size = 1;
+    } else {
+      // update PathTrack
+      // example of PathTrack update
+      // 0
+      // 0 1
+      // 0 1 3
+      // 0 1 3 1
+      // 0 1 3 3
+      // 0 1 3 2 ==> if next is 0 : check if exit
+      path_track[path_track_filling_size - 1] = AllZonesCurrentStatus;
+
+      if (Speculative && pending_direction == 0) {
+        pending_direction = this->direction();
+        if (pending_direction != 0) {
+          ESP_LOGI(TRACKING, "Provisional %s detected.", pending_direction > 0 ? "entry" : "exit");
+          publish(TrackingEvent::Crossing, pending_direction, 50);
+        }
+      }
+    }
+  }
+
+  if (!occupied && !left_previous_status && !right_previous_status && presence) {
+    // nobody is in the sensing area
+    presence = false;
+    publish(TrackingEvent::Presence, 0, 100);
+  }
+}
+
+/**
+ * Checks the path track for a complete crossing.
+ * Returns 1 for an entry, -1 for an exit and 0 otherwise.
+ */
+template<bool Speculative> int PathTracker<Speculative>::direction() const {
+  // check exit or entry only if path_track_filling_size is 4 (for example 0 1 3 2).
+  // no need to check path_track[0] == 0 , it is always the case
+  if (path_track_filling_size != 4) {
+    return 0;
+  }
+  if ((path_track[1] == 1) && (path_track[2] == 3) && (path_track[3] == 2)) {
+    // This an exit
+    return -1;
+  }
+  if ((path_track[1] == 2) && (path_track[2] == 3) && (path_track[3] == 1)) {
+    // This an entry
+    return 1;
+  }
+  return 0;
+}
+
+/**
+ * Decides every episode, from somebody entering the zones until they're both free again, with a classifier over how
+ * long & in which order the zones were occupied (see classifier.h) instead of requiring the exact path. This copes
+ * better with people lingering in the zones and ignores e.g. pets or a door swinging through a single zone.
+ * Crossings are published once the episode is over, with the model's confidence.
+ */
+class ClassifyingTracker {
+ public:
+  template<typename Publish>
+  void update(bool left, bool occupied, uint16_t distance, uint32_t now_ms, Publish &&publish) {
+    bool was_active = this->recorder.is_active();
+    bool finished = this->recorder.add(left, occupied, distance, now_ms);
+    if (!was_active && this->recorder.is_active()) {
+      publish(TrackingEvent::Presence, 1, 100);
+    }
+    if (!finished) {
+      return;
+    }
+    auto features = this->recorder.features();
+    auto result = classify(CROSSING_MODEL, features);
+    ESP_LOGD(TRACKING, "Episode: { dwell: %d/%dms, on: %dms, off: %dms, overlap: %dms, depth: %dmm, speed: %d }",
+             features.values[CrossingFeatures::DWELL_LEFT], features.values[CrossingFeatures::DWELL_RIGHT],
+             features.values[CrossingFeatures::ON_DELTA], features.values[CrossingFeatures::OFF_DELTA],
+             features.values[CrossingFeatures::OVERLAP], features.values[CrossingFeatures::DEPTH],
+             features.values[CrossingFeatures::SPEED]);
+    if (result.direction != 0) {
+      ESP_LOGI(TRACKING, "%s detected (%d%%).", result.direction > 0 ? "Entry" : "Exit", result.confidence);
+      publish(TrackingEvent::Crossing, result.direction, result.confidence);
+    } else {
+      ESP_LOGD(TRACKING, "Ignored the episode (%d%%).", result.confidence);
+    }
+    publish(TrackingEvent::Presence, 0, 100);
+  }
+
+ protected:
+  static constexpr CrossingModel CROSSING_MODEL = ROODE_CROSSING_MODEL;
+  CrossingRecorder recorder{};
+};
+
+/** Reads both zones in turn, so each gets half of the readings */
+class AlternatingScheduler {
+ public:
+  uint8_t next(uint8_t zone, uint16_t /*distance*/) { return 1 - zone; }
+};
+
+/**
+ * Reads a zone a second time while its distance changes and the other zone is idle, which is where a person is moving,
+ * for a finer trace of their path. A zone is never read more than `MaxConsecutive` times in a row, so the other one
+ * keeps at least 1 / (MaxConsecutive + 1) of the readings and path tracking still sees the order both zones change in.
+ * Without clear activity, e.g. an empty doorway or someone standing still, both zones are read in turn.
+ */
+template<uint8_t MaxConsecutive> class ActivityScheduler {
+  static_assert(MaxConsecutive >= 1, "every zone needs to be read");
+
+ public:
+  /** Changes in mm, averaged over the last few readings, below which a zone counts as idle */
+  static const uint16_t IDLE_ACTIVITY = 50;
+
+  uint8_t next(uint8_t zone, uint16_t distance) {
+    uint16_t &last = this->last_distance[zone];
+    int change = last == 0 ? 0 : std::abs(distance - last);
+    last = distance;
+    // moving average over about 4 readings
+    this->activity[zone] += (change - this->activity[zone]) / 4;
+
+    this->consecutive = zone == this->previous ? this->consecutive + 1 : 1;
+    this->previous = zone;
+    uint8_t other = 1 - zone;
+    if (this->consecutive < MaxConsecutive && this->activity[zone] > IDLE_ACTIVITY &&
+        this->activity[other] <= IDLE_ACTIVITY) {
+      return zone;
+    }
+    return other;
+  }
+
+ protected:
+  int activity[2] = {0, 0};
+  uint16_t last_distance[2] = {0, 0};
+  uint8_t previous{0};
+  uint8_t consecutive{0};
+};
+
+#ifndef ROODE_FILTER
+#define ROODE_FILTER MinimumFilter<16>
+#endif
+#ifndef ROODE_DETECTOR
+#define ROODE_DETECTOR ThresholdDetector
+#endif
+#ifndef ROODE_TRACKER
+#define ROODE_TRACKER PathTracker<false>
+#endif
+#ifndef ROODE_SCHEDULER
+#define ROODE_SCHEDULER AlternatingScheduler
+#endif
+using Filter = ROODE_FILTER;
+using Detector = ROODE_DETECTOR;
+using Tracker = ROODE_TRACKER;
+using Scheduler = ROODE_SCHEDULER;
+
+}  // namespace roode
+}  // namespace esphome
@@ -0,0 +1,135 @@
+#include "raw_stream.h"
+
+namespace esphome {
+namespace roode {
+
+static void put_uint16(uint8_t *data, uint16_t value) {
+  data[0] = value & 0xFF;
+  data[1] = value >> 8;
+}
+
+static void put_uint32(uint8_t *data, uint32_t value) {
+  put_uint16(data, value & 0xFFFF);
+  put_uint16(data + 2, value >> 16);
+}
+
+void RawStream::dump_config() const {
+  ESP_LOGCONFIG(RAW_STREAM, "  Raw stream: { enabled: %s, packet size: %d, flush interval: %ums }",
+                YESNO(enabled), packet_size, flush_interval_ms);
+}
+
+void RawStream::set_enabled(bool enabled) {
+  if (this->enabled == enabled) {
+    return;
+  }
+  if (!enabled) {
+    flush();
+  }
+  ESP_LOGI(RAW_STREAM, "%s raw stream", enabled ? "Enabling" : "Disabling");
+  this->enabled = enabled;
+}
+
+void RawStream::loop() {
+  transport->loop();
+  if (count > 0 && millis() - packet_started_ms >= flush_interval_ms) {
+    flush();
+  }
+}
+
+void RawStream::add_sample(uint8_t zone, uint16_t distance, VL53L1_Error status, uint32_t timestamp_us) {
+  if (!enabled || !transport->is_connected()) {
+    return;
+  }
+  uint32_t now = timestamp_us;
+  uint32_t delta = (now - last_sample_us) / 100;
+  // A delta which doesn't fit starts a new packet, which carries an absolute timestamp
+  if (count > 0 && (length + SAMPLE_SIZE > packet_size || delta > UINT16_MAX)) {
+    flush();
+  }
+  if (count == 0) {
+    start_packet(now);
+    delta = 0;
+  }
+  uint8_t *sample = buffer.data() + length;
+  sample[0] = (zone ? 0x80 : 0) | (status & 0x7F);
+  put_uint16(sample + 1, distance);
+  put_uint16(sample + 3, delta);
+  length += SAMPLE_SIZE;
+  count++;
+  last_sample_us = now;
+}
+
+void RawStream::start_packet(uint32_t timestamp_us) {
+  buffer[0] = 'R';
+  buffer[1] = VERSION;
+  put_uint32(buffer.data() + 4, timestamp_us);
+  length = HEADER_SIZE;
+  packet_started_ms = millis();
+}
+
+void RawStream::flush() {
+  if (count == 0) {
+    return;
+  }
+  put_uint16(buffer.data() + 2, count);
+  if (transport->is_connected()) {
+    transport->write(buffer.data(), length);
+  }
+  length = 0;
+  count = 0;
+}
+
+#ifdef USE_ROODE_RAW_STREAM_TCP
+bool TcpRawStreamTransport::listen() {
+  server = socket::socket_ip(SOCK_STREAM, 0);
+  if (server == nullptr) {
+    ESP_LOGW(RAW_STREAM, "Could not create socket");
+    return false;
+  }
+  int enable = 1;
+  server->setsockopt(SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(int));
+  server->setblocking(false);
+
+  struct sockaddr_storage address {};
+  socklen_t address_length = socket::set_sockaddr_any((struct sockaddr *) &address, sizeof(address), port);
+  if (server->bind((struct sockaddr *) &address, address_length) != 0 || server->listen(1) != 0) {
+    ESP_LOGW(RAW_STREAM, "Could not listen on port %d, errno: %d", port, errno);
+    server = nullptr;
+    return false;
+  }
+  ESP_LOGI(RAW_STREAM, "Listening on port %d", port);
+  return true;
+}
+
+void TcpRawStreamTransport::loop() {
+  // The network may not be up yet when booting, so listening is retried until it works
+  if (server == nullptr && !listen()) {
+    return;
+  }
+  struct sockaddr_storage address {};
+  socklen_t address_length = sizeof(address);
+  auto accepted = server->accept((struct sockaddr *) &address, &address_length);
+  if (accepted == nullptr) {
+    return;
+  }
+  // Only one client at a time, the newest one wins
+  accepted->setblocking(false);
+  int enable = 1;
+  accepted->setsockopt(IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(int));
+  client = std::move(accepted);
+  ESP_LOGI(RAW_STREAM, "Client connected: %s", client->getpeername().c_str());
+}
+
+void TcpRawStreamTransport::write(const uint8_t *data, size_t length) {
+  ssize_t written = client->write(data, length);
+  if (written == (ssize_t) length) {
+    return;
+  }
+  // A partial write would break the framing and a full send buffer means the client can't keep up
+  ESP_LOGW(RAW_STREAM, "Dropping client, written: %d of %d bytes, errno: %d", (int) written, (int) length, errno);
+  client = nullptr;
+}
+#endif
+
+}  // namespace roode
+}  // namespace esphome
@@ -0,0 +1,103 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <memory>
+
+#include "esphome/core/component.h"
+#include "esphome/core/defines.h"
+#include "esphome/core/hal.h"
+#include "esphome/core/log.h"
+#include "../vl53l1x/vl53l1x.h"
+#ifdef USE_ROODE_RAW_STREAM_UART
+#include "esphome/components/uart/uart.h"
+#endif
+#ifdef USE_ROODE_RAW_STREAM_TCP
+#include "esphome/components/socket/socket.h"
+#endif
+
+namespace esphome {
+namespace roode {
+static const char *const RAW_STREAM = "Raw stream";
+
+/** Largest packet, the TCP payload of a 1500 byte ethernet/WiFi frame */
+static const uint16_t RAW_STREAM_MAX_PACKET_SIZE = 1460;
+
+/** Where the raw stream packets go to */
+class RawStreamTransport {
+ public:
+  virtual ~RawStreamTransport() = default;
+  virtual void loop() {}
+  /** Whether anybody is listening, samples are discarded otherwise */
+  virtual bool is_connected() { return true; }
+  virtual void write(const uint8_t *data, size_t length) = 0;
+};
+
+#ifdef USE_ROODE_RAW_STREAM_UART
+class UartRawStreamTransport : public RawStreamTransport {
+ public:
+  explicit UartRawStreamTransport(uart::UARTComponent *uart) : uart(uart) {}
+  void write(const uint8_t *data, size_t length) override { this->uart->write_array(data, length); }
+
+ protected:
+  uart::UARTComponent *uart;
+};
+#endif
+
+#ifdef USE_ROODE_RAW_STREAM_TCP
+/** Listens on a TCP port, streaming to a single client at a time */
+class TcpRawStreamTransport : public RawStreamTransport {
+ public:
+  explicit TcpRawStreamTransport(uint16_t port) : port(port) {}
+  void loop() override;
+  bool is_connected() override { return this->client != nullptr; }
+  void write(const uint8_t *data, size_t length) override;
+
+ protected:
+  bool listen();
+  uint16_t port;
+  std::unique_ptr<socket::Socket> server{};
+  std::unique_ptr<socket::Socket> client{};
+};
+#endif
+
+/**
+ * Streams every raw zone reading as compact binary packets, so a door can be debugged at the full sampling rate
+ * without going through the entity API.
+ *
+ * All values are little endian. A packet is an 8 byte header followed by 5 bytes per sample:
+ *   header: 'R', version (1), sample count (uint16), timestamp of the first sample in µs (uint32)
+ *   sample: zone id in the highest bit & the VL53L1X status in the lower 7 bits (int7), distance in mm (uint16),
+ *           time since the previous sample in units of 100µs (uint16, 0 for the first sample)
+ * Samples are batched up to the packet size, or until the flush interval passed since the first sample in the packet.
+ */
+class RawStream {
+ public:
+  static const uint8_t VERSION = 1;
+  static const uint8_t HEADER_SIZE = 8;
+  static const uint8_t SAMPLE_SIZE = 5;
+
+  explicit RawStream(RawStreamTransport *transport) : transport(transport) {}
+  void set_packet_size(uint16_t size) { packet_size = std::min(size, RAW_STREAM_MAX_PACKET_SIZE); }
+  void set_flush_interval(uint32_t interval_ms) { flush_interval_ms = interval_ms; }
+  void set_enabled(bool enabled);
+  bool is_enabled() const { return enabled; }
+  void loop();
+  void add_sample(uint8_t zone, uint16_t distance, VL53L1_Error status, uint32_t timestamp_us);
+  void dump_config() const;
+
+ protected:
+  void start_packet(uint32_t timestamp_us);
+  void flush();
+  RawStreamTransport *transport;
+  bool enabled{false};
+  uint16_t packet_size{RAW_STREAM_MAX_PACKET_SIZE};
+  uint32_t flush_interval_ms{100};
+  std::array<uint8_t, RAW_STREAM_MAX_PACKET_SIZE> buffer{};
+  uint16_t length{0};
+  uint16_t count{0};
+  uint32_t packet_started_ms{0};
+  uint32_t last_sample_us{0};
+};
+
+}  // namespace roode
+}  // namespace esphome
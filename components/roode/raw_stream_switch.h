@@ -0,0 +1,22 @@
+#pragma once
+#include "esphome/components/switch/switch.h"
+#include "esphome/core/component.h"
+#include "raw_stream.h"
+
+namespace esphome {
+namespace roode {
+/** Turns the raw stream on & off at runtime */
+class RawStreamSwitch : public switch_::Switch, public Component {
+ public:
+  void set_raw_stream(RawStream *raw_stream) { this->raw_stream = raw_stream; }
+  void setup() override { this->publish_state(this->raw_stream->is_enabled()); }
+
+ protected:
+  void write_state(bool state) override {
+    this->raw_stream->set_enabled(state);
+    this->publish_state(state);
+  }
+  RawStream *raw_stream;
+};
+}  // namespace roode
+}  // namespace esphome
@@ -0,0 +1,172 @@
+#include "roi_optimizer.h"
+
+namespace esphome {
+namespace roode {
+static const char *const OPTIMIZER = "ROI optimizer";
+
+/** Sizes along the walking direction, which are tried when not overridden */
+static const uint8_t CANDIDATE_SIZES[] = {4, 6, 8};
+/** Noise is negligible beyond this many standard deviations between the idle distance and the threshold */
+static const float MAX_SCORE = 20;
+/** Score lost per SPAD row/column of gap between the zones */
+static const float GAP_PENALTY = 0.05f;
+
+void RoiOptimizer::optimize(Zone &entry, Zone &exit) {
+  ESP_LOGI(OPTIMIZER, "Optimizing ROIs");
+  const ROI entry_roi = entry.roi;
+  const ROI exit_roi = exit.roi;
+  Candidates entry_candidates{};
+  Candidates exit_candidates{};
+  uint8_t entry_count = measure_candidates(entry, entry_candidates);
+  uint8_t exit_count = measure_candidates(exit, exit_candidates);
+
+  const Candidate *best_entry = nullptr;
+  const Candidate *best_exit = nullptr;
+  float best_score = 0;
+  for (uint8_t i = 0; i < entry_count; i++) {
+    for (uint8_t j = 0; j < exit_count; j++) {
+      const auto &e = entry_candidates[i];
+      const auto &x = exit_candidates[j];
+      float asymmetry = fabsf(e.mean - x.mean) / max(max(e.mean, x.mean), (uint16_t) 1);
+      int gap = max(0, x.start - (e.start + e.size));
+      // slightly prefer larger ROIs on ties, they collect more signal
+      float score = min(e.score, x.score) * (1 - asymmetry) * (1 - GAP_PENALTY * gap) + 0.01f * (e.size + x.size);
+      if (best_entry == nullptr || score > best_score) {
+        best_score = score;
+        best_entry = &e;
+        best_exit = &x;
+      }
+    }
+  }
+
+  if (best_entry == nullptr) {
+    ESP_LOGW(OPTIMIZER, "No ROI candidates could be measured, keeping current ROIs");
+    entry.roi = entry_roi;
+    exit.roi = exit_roi;
+    return;
+  }
+  entry.roi = best_entry->roi;
+  exit.roi = best_exit->roi;
+  for (const Zone *zone : {&entry, &exit}) {
+    ESP_LOGI(CALIBRATION, "Calibrated ROI for zone. zoneId: %d, width: %d, height: %d, center: %d", zone->id,
+             zone->roi.width, zone->roi.height, zone->roi.center);
+  }
+}
+
+/**
+ * Measures every ROI the zone could use within its half of the SPAD grid, honoring the zone's overrides.
+ */
+uint8_t RoiOptimizer::measure_candidates(Zone &zone, Candidates &candidates) {
+  const ROI &override = zone.roi_override;
+  uint8_t size_override = orientation == Parallel ? override.width : override.height;
+  // The entry zone covers the first half of the grid along the walking direction, the exit zone the second one
+  uint8_t half_start = zone.id == 0U ? 0 : 8;
+
+  uint8_t count = 0;
+  for (uint8_t size : CANDIDATE_SIZES) {
+    if (size_override) {
+      size = size_override;
+    }
+    if (override.center || size > 8) {
+      // Fixed position, or a size that doesn't fit in the half: only the current ROI can be measured, and only once
+      Candidate candidate{};
+      candidate.roi = zone.roi;
+      if (override.center) {
+        candidate.roi.center = override.center;
+      }
+      candidate.size = size_override ? size_override : orientation == Parallel ? zone.roi.width : zone.roi.height;
+      candidate.start = start_of(candidate.roi.center, candidate.size);
+      if (measure(zone, candidate)) {
+        candidates[count++] = candidate;
+      }
+      break;
+    } else {
+      for (uint8_t start = half_start; start + size <= half_start + 8 && count < candidates.size(); start++) {
+        Candidate candidate{};
+        candidate.size = size;
+        candidate.start = start;
+        candidate.roi = to_roi(start, size);
+        if (measure(zone, candidate)) {
+          candidates[count++] = candidate;
+        }
+      }
+    }
+    if (size_override) {
+      break;
+    }
+  }
+  return count;
+}
+
+bool RoiOptimizer::measure(Zone &zone, Candidate &candidate) {
+  if (zone.roi_override.width) {
+    candidate.roi.width = zone.roi_override.width;
+  }
+  if (zone.roi_override.height) {
+    candidate.roi.height = zone.roi_override.height;
+  }
+  const ROI previous = zone.roi;
+  zone.roi = candidate.roi;
+
+  uint32_t sum = 0;
+  uint64_t sum_squared = 0;
+  for (int i = 0; i < number_attempts; i++) {
+    if (zone.readDistance(sensor) != VL53L1_ERROR_NONE) {
+      zone.roi = previous;
+      return false;
+    }
+    uint32_t distance = zone.getDistance();
+    sum += distance;
+    sum_squared += distance * distance;
+    App.feed_wdt();
+  }
+  candidate.mean = sum / number_attempts;
+  candidate.sd = sqrt(max((int64_t) 0, (int64_t) (sum_squared / number_attempts) - candidate.mean * candidate.mean));
+
+  // Distance between the idle reading and the detection threshold, in standard deviations
+  float margin = candidate.mean - zone.threshold.max_for(candidate.mean);
+  candidate.score = min(MAX_SCORE, margin / max(candidate.sd, (uint16_t) 1));
+  ESP_LOGD(OPTIMIZER, "zoneId: %d, width: %d, height: %d, center: %d, mean: %d, sd: %d, score: %.1f", zone.id,
+           candidate.roi.width, candidate.roi.height, candidate.roi.center, candidate.mean, candidate.sd,
+           candidate.score);
+  return true;
+}
+
+/**
+ * Builds the ROI covering `size` rows/columns along the walking direction starting at `start`.
+ * Across the walking direction it covers twice as many, centered on the grid.
+ */
+ROI RoiOptimizer::to_roi(uint8_t start, uint8_t size) const {
+  uint8_t across = min(16, size * 2);
+  uint8_t across_start = 8 - across / 2;
+  // The center SPAD is the one above and to the right of the exact center
+  uint8_t column;
+  uint8_t row;
+  ROI roi{};
+  if (orientation == Parallel) {
+    column = start + size / 2;
+    row = across_start + (across - 1) / 2;
+    roi.width = size;
+    roi.height = across;
+  } else {
+    column = across_start + across / 2;
+    row = start + (size - 1) / 2;
+    roi.width = across;
+    roi.height = size;
+  }
+  // See the SPAD table in the README
+  roi.center = row < 8 ? 128 + 8 * column + row : 127 - 8 * column - (row - 8);
+  return roi;
+}
+
+uint8_t RoiOptimizer::start_of(uint8_t center, uint8_t size) const {
+  uint8_t column = center >= 128 ? (center - 128) / 8 : (127 - center) / 8;
+  uint8_t row = center >= 128 ? (center - 128) % 8 : 8 + (127 - center) % 8;
+  if (orientation == Parallel) {
+    return max(0, column - size / 2);
+  }
+  return max(0, row - (size - 1) / 2);
+}
+
+}  // namespace roode
+}  // namespace esphome
@@ -0,0 +1,52 @@
+#pragma once
+#include <array>
+
+#include "esphome/core/log.h"
+#include "../vl53l1x/vl53l1x.h"
+#include "orientation.h"
+#include "zone.h"
+
+namespace esphome {
+namespace roode {
+
+/**
+ * Picks the ROI size & position of both zones by measuring candidates in the empty doorway.
+ *
+ * The SPAD grid is split in two halves along the walking direction, one per zone. Every size & position a zone's ROI
+ * can take within its half is measured and scored by how far its idle distance is above the detection threshold,
+ * relative to the noise. Pairs are then scored by their weakest zone, with penalties for zones disagreeing on the
+ * idle distance (i.e. one of them seeing the door frame) and for a gap between the zones, as path tracking needs a
+ * person to be seen by both zones at once. ROI overrides always take precedence over the optimizer.
+ */
+class RoiOptimizer {
+ public:
+  RoiOptimizer(TofSensor *distanceSensor, Orientation orientation) : sensor(distanceSensor), orientation(orientation) {}
+  void optimize(Zone &entry, Zone &exit);
+
+ protected:
+  struct Candidate {
+    ROI roi;
+    /** First SPAD row/column covered along the walking direction */
+    uint8_t start;
+    /** Number of SPAD rows/columns covered along the walking direction */
+    uint8_t size;
+    uint16_t mean;
+    uint16_t sd;
+    float score;
+  };
+  /** Sizes are limited to 4..8 so there are at most 5 + 3 + 1 positions */
+  using Candidates = std::array<Candidate, 9>;
+
+  uint8_t measure_candidates(Zone &zone, Candidates &candidates);
+  bool measure(Zone &zone, Candidate &candidate);
+  ROI to_roi(uint8_t start, uint8_t size) const;
+  uint8_t start_of(uint8_t center, uint8_t size) const;
+
+  TofSensor *sensor;
+  Orientation orientation;
+  /** Readings taken per candidate */
+  int number_attempts = 5;
+};
+
+}  // namespace roode
+}  // namespace esphome
@@ -6,15 +6,43 @@ void Roode::dump_config() {
   ESP_LOGCONFIG(TAG, "Roode:");
   ESP_LOGCONFIG(TAG, "  Sample size: %d", samples);
   LOG_UPDATE_INTERVAL(this);
-  entry->dump_config();
-  exit->dump_config();
+  ESP_LOGCONFIG(TAG, "  Acquisition task: %s", YESNO(queue_events));
+  if (total_sensor_errors > 0) {
+    ESP_LOGCONFIG(TAG, "  Sensor errors:");
+    for (uint8_t i = 0; i < SENSOR_ERROR_CODES; i++) {
+      if (sensor_errors[i] > 0) {
+        ESP_LOGCONFIG(TAG, "    %d: %u", -i, sensor_errors[i]);
+      }
+    }
+  }
+  if (idle_after_ms > 0) {
+    ESP_LOGCONFIG(TAG, "  Idle: { after: %ums, interval: %ums, light sleep: %ums }", idle_after_ms, idle_interval_ms,
+                  light_sleep_ms);
+    ESP_LOGCONFIG(TAG, "  Time active/idle/asleep: %us/%us/%us, estimated %.1fmWh per hour",
+                  (uint32_t) (get_power_state_time(PowerState::Active) / 1000),
+                  (uint32_t) (get_power_state_time(PowerState::Idle) / 1000),
+                  (uint32_t) (get_power_state_time(PowerState::Sleeping) / 1000), get_energy_per_hour());
+  }
+  ESP_LOGCONFIG(TAG, "  Calibration samples: { tolerance: %umm, min: %u, max: %u, entry: %u, exit: %u }",
+                calibration_sampling.tolerance, calibration_sampling.min_samples, calibration_sampling.max_samples,
+                calibration_samples[entry.id], calibration_samples[exit.id]);
+  entry.dump_config();
+  exit.dump_config();
+  if (raw_stream != nullptr) {
+    raw_stream->dump_config();
+  }
+  if (event_log != nullptr) {
+    event_log->dump_config();
+  }
 }
 
 void Roode::setup() {
   ESP_LOGI(SETUP, "Booting Roode %s", VERSION);
+#ifdef USE_TEXT_SENSOR
   if (version_sensor != nullptr) {
     version_sensor->publish_state(VERSION);
   }
+#endif
   ESP_LOGI(SETUP, "Using sampling with sampling size: %d", samples);
 
   if (this->distanceSensor->is_failed()) {
@@ -23,161 +51,490 @@ void Roode::setup() {
     return;
   }
 
-  calibrate_zones();
+  if (event_log != nullptr) {
+    event_log->setup();
+  }
+  if (persist_calibration_) {
+    calibration_hash_ = compute_calibration_hash();
+    calibration_pref_ = global_preferences->make_preference<CalibrationSnapshot>(calibration_hash_, true);
+  }
+  if (!persist_calibration_ || !restore_calibration()) {
+    calibrate_zones();
+  }
+  if (light_sleep_ms > 0 && distanceSensor->get_interrupt_pin() == nullptr) {
+    ESP_LOGW(SETUP, "Light sleep needs the interrupt pin of the sensor, staying awake while idle");
+    light_sleep_ms = 0;
+  }
+  power_state_since_ms = reported_power_state_since_ms = last_occupied_ms = millis();
+  start_acquisition();
+}
+
+void Roode::on_shutdown() {
+  stop_acquisition();
+  if (event_log != nullptr) {
+    event_log->flush();
+  }
 }
 
 void Roode::update() {
+#ifdef USE_SENSOR
   if (distance_entry != nullptr) {
-    distance_entry->publish_state(entry->getDistance());
+    distance_entry->publish_state(distances[entry.id]);
   }
   if (distance_exit != nullptr) {
-    distance_exit->publish_state(exit->getDistance());
+    distance_exit->publish_state(distances[exit.id]);
+  }
+  if (heap_watermark_sensor != nullptr && heap_watermark != UINT32_MAX) {
+    heap_watermark_sensor->publish_state(heap_watermark);
+  }
+  for (uint8_t i = 0; i < POWER_STATES; i++) {
+    if (power_state_sensors[i] != nullptr) {
+      power_state_sensors[i]->publish_state(get_power_state_time(static_cast<PowerState>(i)) / 1000.0f);
+    }
+  }
+  if (energy_per_hour_sensor != nullptr) {
+    energy_per_hour_sensor->publish_state(get_energy_per_hour());
   }
+#endif
 }
 
 void Roode::loop() {
+#ifdef USE_ROODE_ACQUISITION_TASK
+  if (queue_events) {
+    handle_queued_events();
+  } else {
+    acquire();
+  }
+#else
+  acquire();
+#endif
+  if (raw_stream != nullptr) {
+    raw_stream->loop();
+  }
+  if (event_log != nullptr) {
+    event_log->loop();
+  }
+#ifdef USE_SENSOR
+  if (heap_watermark_sensor != nullptr) {
+    sample_free_heap();
+  }
+#endif
+}
+
+/**
+ * Reads the current zone and tracks the path, in the acquisition task if enabled or the main loop otherwise.
+ * Returns false if nothing was read because the sensor is recovering.
+ */
+bool Roode::acquire() {
   // unsigned long start = micros();
-  this->current_zone->readDistance(distanceSensor);
+  if (recovery_step != RecoveryStep::None && (int32_t) (millis() - next_recovery_attempt_ms) < 0) {
+    // backing off, give the sensor & bus some time
+    return false;
+  }
+  if (power_state != PowerState::Active) {
+    return wait_for_presence();
+  }
+  auto status = this->current_zone->readDistance(distanceSensor);
+  this->emit({AcquisitionEvent::Sample, this->current_zone->id, status, 0, this->current_zone->getDistance(), micros()});
+  if (!handle_sensor_status(status)) {
+    // the zone's distance is stale, try the same zone again
+    return true;
+  }
   // uint16_t samplingDistance = sampling(this->current_zone);
   path_tracking(this->current_zone);
-  handle_sensor_status();
-  this->current_zone = this->current_zone == this->entry ? this->exit : this->entry;
-  // ESP_LOGI("Experimental", "Entry zone: %d, exit zone: %d",
-  // entry->getDistance(Roode::distanceSensor, Roode::sensor_status),
-  // exit->getDistance(Roode::distanceSensor, Roode::sensor_status)); unsigned
-  // long end = micros(); unsigned long delta = end - start; ESP_LOGI("Roode
+  auto next = scheduler.next(this->current_zone->id, this->current_zone->getDistance());
+  this->current_zone = next == this->entry.id ? &this->entry : &this->exit;
+  if (idle_after_ms > 0 && millis() - last_occupied_ms >= idle_after_ms) {
+    enter_idle();
+  }
+  // unsigned long end = micros(); unsigned long delta = end - start; ESP_LOGI("Roode
   // loop", "loop took %lu microseconds", delta);
+  return true;
 }
 
-bool Roode::handle_sensor_status() {
-  bool check_status = false;
-  if (last_sensor_status != sensor_status && sensor_status == VL53L1_ERROR_NONE) {
-    if (status_sensor != nullptr) {
-      status_sensor->publish_state(sensor_status);
+/**
+ * Hands watching the doorway over to the sensor: it ranges the whole field of view by itself every idle interval and
+ * raises its interrupt once something is closer than the max threshold of either zone.
+ */
+void Roode::enter_idle() {
+  uint16_t below = std::min(entry.threshold.max, exit.threshold.max);
+  auto status = distanceSensor->start_presence_detection(below, idle_interval_ms);
+  if (status != VL53L1_ERROR_NONE) {
+    distanceSensor->stop_presence_detection();
+    // try again after another idle period
+    last_occupied_ms = millis();
+    handle_sensor_status(status);
+    return;
+  }
+  ESP_LOGD(TAG, "Nobody seen for %ums, idling", idle_after_ms);
+  set_power_state(PowerState::Idle);
+}
+
+/**
+ * Checks whether the sensor saw somebody while idle, and goes back to ranging both zones if it did.
+ * Returns false while nobody is there, as nothing was read.
+ */
+bool Roode::wait_for_presence() {
+  // the interrupt pin is free to check, without it every check is an I2C transaction
+  if (distanceSensor->get_interrupt_pin() == nullptr &&
+      millis() - last_presence_check_ms < idle_measurement_interval()) {
+    return false;
+  }
+  last_presence_check_ms = millis();
+  VL53L1_Error status;
+  bool present = distanceSensor->check_presence(status);
+  if (status == VL53L1_ERROR_NONE && !present) {
+    light_sleep();
+    return false;
+  }
+  ESP_LOGD(TAG, "Presence detected, ranging both zones again");
+  auto stop_status = exit_idle();
+  if (handle_sensor_status(status != VL53L1_ERROR_NONE ? status : stop_status)) {
+    seed_tracker();
+  }
+  return true;
+}
+
+/**
+ * Whoever woke the sensor is already under it, and reading one zone per loop like the scheduler would miss where they
+ * came from. Both zones are read right away instead. If both are occupied, the tracker gets the zone they're deeper in
+ * first, as that's the side they came from.
+ */
+void Roode::seed_tracker() {
+  for (Zone *zone : {&this->entry, &this->exit}) {
+    auto status = zone->readDistance(distanceSensor);
+    this->emit({AcquisitionEvent::Sample, zone->id, status, 0, zone->getDistance(), micros()});
+    if (!handle_sensor_status(status)) {
+      return;
     }
-    check_status = true;
   }
-  if (sensor_status < 28 && sensor_status != VL53L1_ERROR_NONE) {
-    ESP_LOGE(TAG, "Ranging failed with an error. status: %d", sensor_status);
-    status_sensor->publish_state(sensor_status);
-    check_status = false;
+  Zone *first = this->exit.getMinDistance() < this->entry.getMinDistance() ? &this->exit : &this->entry;
+  Zone *second = first == &this->entry ? &this->exit : &this->entry;
+  path_tracking(first);
+  path_tracking(second);
+  auto next = scheduler.next(second->id, second->getDistance());
+  this->current_zone = next == this->entry.id ? &this->entry : &this->exit;
+}
+
+VL53L1_Error Roode::exit_idle() {
+  auto status = distanceSensor->stop_presence_detection();
+  set_power_state(PowerState::Active);
+  last_occupied_ms = millis();
+  this->current_zone = &this->entry;
+  return status;
+}
+
+/**
+ * Light sleeps until the sensor's interrupt or for `light_sleep_ms`, whichever comes first. Nothing else runs in the
+ * meantime and WiFi misses the beacons, so this is for battery powered nodes that can take the latency.
+ */
+void Roode::light_sleep() {
+#ifdef USE_ESP32
+  auto *pin = distanceSensor->get_interrupt_pin();
+  if (light_sleep_ms == 0 || pin == nullptr || queue_events) {
+    return;
   }
+  auto gpio = static_cast<gpio_num_t>(pin->get_pin());
+  gpio_wakeup_enable(gpio, pin->is_inverted() ? GPIO_INTR_LOW_LEVEL : GPIO_INTR_HIGH_LEVEL);
+  esp_sleep_enable_gpio_wakeup();
+  esp_sleep_enable_timer_wakeup(uint64_t(light_sleep_ms) * 1000);
+  set_power_state(PowerState::Sleeping);
+  esp_light_sleep_start();
+  set_power_state(PowerState::Idle);
+  esp_sleep_disable_wakeup_source(ESP_SLEEP_WAKEUP_ALL);
+  gpio_wakeup_disable(gpio);
+#endif
+}
 
-  last_sensor_status = sensor_status;
-  sensor_status = VL53L1_ERROR_NONE;
-  return check_status;
+void Roode::set_power_state(PowerState state) {
+  uint32_t now = millis();
+  this->emit({AcquisitionEvent::PowerStateChange, static_cast<uint8_t>(state), VL53L1_ERROR_NONE,
+              static_cast<int8_t>(power_state), 0, now - power_state_since_ms});
+  power_state = state;
+  power_state_since_ms = now;
 }
 
-void Roode::path_tracking(Zone *zone) {
-  static int PathTrack[] = {0, 0, 0, 0};
-  static int PathTrackFillingSize = 1;  // init this to 1 as we start from state
-                                        // where nobody is any of the zones
-  static int LeftPreviousStatus = NOBODY;
-  static int RightPreviousStatus = NOBODY;
-  int CurrentZoneStatus = NOBODY;
-  int AllZonesCurrentStatus = 0;
-  int AnEventHasOccured = 0;
-
-  // PathTrack algorithm
-  if (zone->getMinDistance() < zone->threshold->max && zone->getMinDistance() > zone->threshold->min) {
-    // Someone is in the sensing area
-    CurrentZoneStatus = SOMEONE;
-    if (presence_sensor != nullptr) {
-      presence_sensor->publish_state(true);
-    }
+uint64_t Roode::get_power_state_time(PowerState state) const {
+  uint64_t time = power_state_ms[static_cast<uint8_t>(state)];
+  if (state == reported_power_state) {
+    time += millis() - reported_power_state_since_ms;
   }
+  return time;
+}
 
-  // left zone
-  if (zone == (this->invert_direction_ ? this->exit : this->entry)) {
-    if (CurrentZoneStatus != LeftPreviousStatus) {
-      // event in left zone has occured
-      AnEventHasOccured = 1;
+/** The sensor can't measure any faster than the ranging mode does */
+uint32_t Roode::idle_measurement_interval() const {
+  const RangingMode *mode = distanceSensor->get_ranging_mode();
+  return mode != nullptr ? std::max<uint32_t>(idle_interval_ms, mode->delay_between_measurements) : idle_interval_ms;
+}
 
-      if (CurrentZoneStatus == SOMEONE) {
-        AllZonesCurrentStatus += 1;
-      }
-      // need to check right zone as well ...
-      if (RightPreviousStatus == SOMEONE) {
-        // event in right zone has occured
-        AllZonesCurrentStatus += 2;
+float Roode::get_energy_per_hour() const {
+  const RangingMode *mode = distanceSensor->get_ranging_mode();
+  float duty = 0;
+  if (mode != nullptr) {
+    duty = float(mode->timing_budget) / idle_measurement_interval();
+  }
+  float idle_sensor_ma = SENSOR_STANDBY_MA + duty * SENSOR_RANGING_MA;
+  const float current_ma[POWER_STATES] = {MCU_ACTIVE_MA + SENSOR_RANGING_MA, MCU_ACTIVE_MA + idle_sensor_ma,
+                                          MCU_LIGHT_SLEEP_MA + idle_sensor_ma};
+  uint64_t total_ms = 0;
+  float charge = 0;
+  for (uint8_t i = 0; i < POWER_STATES; i++) {
+    uint64_t time = get_power_state_time(static_cast<PowerState>(i));
+    total_ms += time;
+    charge += time * current_ma[i];
+  }
+  return total_ms > 0 ? charge / total_ms * SUPPLY_VOLTAGE : NAN;
+}
+
+#ifdef USE_ROODE_ACQUISITION_TASK
+void Roode::acquisition_loop(void *roode) {
+  if (!static_cast<Roode *>(roode)->acquire()) {
+    delay(1);
+  }
+}
+#endif
+
+void Roode::start_acquisition() {
+#ifdef USE_ROODE_ACQUISITION_TASK
+  if (!use_acquisition_task_) {
+    return;
+  }
+  queue_events = true;
+  distanceSensor->set_driven_by_task(true);
+  if (!acquisition_task.start()) {
+    ESP_LOGW(TAG, "Falling back to acquisition in the main loop");
+    queue_events = false;
+    distanceSensor->set_driven_by_task(false);
+  }
+#endif
+}
+
+/** Stops the acquisition task and handles whatever it left in the queue */
+void Roode::stop_acquisition() {
+#ifdef USE_ROODE_ACQUISITION_TASK
+  if (!queue_events) {
+    return;
+  }
+  acquisition_task.stop();
+  distanceSensor->set_driven_by_task(false);
+  queue_events = false;
+  handle_queued_events();
+  if (samples_queue.get_dropped() > 0) {
+    ESP_LOGD(TAG, "Samples dropped while the main loop lagged behind: %u", samples_queue.get_dropped());
+  }
+  if (control_queue.get_dropped() > 0) {
+    ESP_LOGW(TAG, "Acquisition events dropped: %u", control_queue.get_dropped());
+  }
+#endif
+}
+
+#ifdef USE_ROODE_ACQUISITION_TASK
+/** Control events first, samples don't affect them */
+void Roode::handle_queued_events() {
+  AcquisitionEvent event{};
+  while (control_queue.pop(event)) {
+    handle_event(event);
+  }
+  while (samples_queue.pop(event)) {
+    handle_event(event);
+  }
+}
+#endif
+
+/**
+ * Hands an event over to the main loop, or handles it right away if acquisition runs in the main loop.
+ * A lagging main loop costs samples, but crossings & state changes wait for it as losing one would skew the count.
+ */
+void Roode::emit(const AcquisitionEvent &event) {
+#ifdef USE_ROODE_ACQUISITION_TASK
+  if (queue_events) {
+    if (event.type == AcquisitionEvent::Sample) {
+      if (!samples_queue.push(event)) {
+        ESP_LOGV(TAG, "Sample queue full, dropping sample of zone %d", event.zone);
       }
-      // remember for next time
-      LeftPreviousStatus = CurrentZoneStatus;
+      return;
     }
+    // only gives up while the task is being stopped, the main loop isn't handling events then
+    while (control_queue.is_full() && acquisition_task.is_running()) {
+      AcquisitionTask::feed_wdt();
+      delay(1);
+    }
+    if (!control_queue.push(event)) {
+      ESP_LOGW(TAG, "Event queue full, dropping event: %d", event.type);
+    }
+    return;
   }
-  // right zone
-  else {
-    if (CurrentZoneStatus != RightPreviousStatus) {
-      // event in right zone has occured
-      AnEventHasOccured = 1;
-      if (CurrentZoneStatus == SOMEONE) {
-        AllZonesCurrentStatus += 2;
+#endif
+  handle_event(event);
+}
+
+void Roode::handle_event(const AcquisitionEvent &event) {
+  switch (event.type) {
+    case AcquisitionEvent::Sample:
+      distances[event.zone] = event.distance;
+      if (raw_stream != nullptr) {
+        raw_stream->add_sample(event.zone, event.distance, event.status, event.value);
       }
-      // need to check left zone as well ...
-      if (LeftPreviousStatus == SOMEONE) {
-        // event in left zone has occured
-        AllZonesCurrentStatus += 1;
+      break;
+    case AcquisitionEvent::Presence:
+#ifdef USE_BINARY_SENSOR
+      if (presence_sensor != nullptr) {
+        presence_sensor->publish_state(event.direction != 0);
       }
-      // remember for next time
-      RightPreviousStatus = CurrentZoneStatus;
-    }
+#endif
+      break;
+    case AcquisitionEvent::Crossing:
+      publish_event(event.direction, event.value);
+      log_event(event.direction, event.value, false);
+      break;
+    case AcquisitionEvent::Retraction:
+      updateCounter(-event.direction);
+      log_event(event.direction, event.value, true);
+      break;
+    case AcquisitionEvent::SensorStatus:
+#ifdef USE_SENSOR
+      if (status_sensor != nullptr) {
+        status_sensor->publish_state(event.status);
+      }
+      if (sensor_errors_sensor != nullptr && event.status != VL53L1_ERROR_NONE) {
+        sensor_errors_sensor->publish_state(event.value);
+      }
+#endif
+      break;
+    case AcquisitionEvent::SensorRecovered:
+#ifdef USE_SENSOR
+      if (recovery_time_sensor != nullptr) {
+        recovery_time_sensor->publish_state(event.value);
+      }
+#endif
+      break;
+    case AcquisitionEvent::PowerStateChange:
+      power_state_ms[event.direction] += event.value;
+      reported_power_state = static_cast<PowerState>(event.zone);
+      reported_power_state_since_ms = millis();
+      break;
   }
+}
 
-  // if an event has occured
-  if (AnEventHasOccured) {
-    ESP_LOGD(TAG, "Event has occured, AllZonesCurrentStatus: %d", AllZonesCurrentStatus);
-    if (PathTrackFillingSize < 4) {
-      PathTrackFillingSize++;
+/**
+ * Counts failed readings and starts or continues recovering the sensor.
+ * Returns whether the reading succeeded.
+ */
+bool Roode::handle_sensor_status(VL53L1_Error status) {
+  if (status == VL53L1_ERROR_NONE) {
+    if (last_sensor_status != status) {
+      this->emit({AcquisitionEvent::SensorStatus, 0, status, 0, 0, total_sensor_errors});
+    }
+    last_sensor_status = status;
+    if (recovery_step != RecoveryStep::None) {
+      uint32_t recovery_time = millis() - failing_since_ms;
+      ESP_LOGI(TAG, "Sensor recovered after %ums at step %d", recovery_time, (int) recovery_step);
+      this->emit({AcquisitionEvent::SensorRecovered, 0, status, 0, 0, recovery_time});
+      recovery_step = RecoveryStep::None;
     }
+    return true;
+  }
 
-    // if nobody anywhere lets check if an exit or entry has happened
-    if ((LeftPreviousStatus == NOBODY) && (RightPreviousStatus == NOBODY)) {
-      ESP_LOGD(TAG, "Nobody anywhere, AllZonesCurrentStatus: %d", AllZonesCurrentStatus);
-      // check exit or entry only if PathTrackFillingSize is 4 (for example 0 1
-      // 3 2) and last event is 0 (nobobdy anywhere)
-      if (PathTrackFillingSize == 4) {
-        // check exit or entry. no need to check PathTrack[0] == 0 , it is
-        // always the case
-
-        if ((PathTrack[1] == 1) && (PathTrack[2] == 3) && (PathTrack[3] == 2)) {
-          // This an exit
-          ESP_LOGI("Roode pathTracking", "Exit detected.");
-
-          this->updateCounter(-1);
-          if (entry_exit_event_sensor != nullptr) {
-            entry_exit_event_sensor->publish_state("Exit");
-          }
-        } else if ((PathTrack[1] == 2) && (PathTrack[2] == 3) && (PathTrack[3] == 1)) {
-          // This an entry
-          ESP_LOGI("Roode pathTracking", "Entry detected.");
-          this->updateCounter(1);
-          if (entry_exit_event_sensor != nullptr) {
-            entry_exit_event_sensor->publish_state("Entry");
-          }
-        }
-      }
+  last_sensor_status = status;
+  sensor_errors[error_index(status)]++;
+  total_sensor_errors++;
+  this->emit({AcquisitionEvent::SensorStatus, 0, status, 0, 0, total_sensor_errors});
+  if (recovery_step == RecoveryStep::None) {
+    ESP_LOGW(TAG, "Ranging failed with an error. status: %d", status);
+    failing_since_ms = millis();
+    recovery_attempts = 0;
+    recovery_backoff_exponent = 0;
+  }
+  recover_sensor();
+  return false;
+}
 
-      PathTrackFillingSize = 1;
-    } else {
-      // update PathTrack
-      // example of PathTrack update
-      // 0
-      // 0 1
-      // 0 1 3
-      // 0 1 3 1
-      // 0 1 3 3
-      // 0 1 3 2 ==> if next is 0 : check if exit
-      PathTrack[PathTrackFillingSize - 1] = AllZonesCurrentStatus;
-    }
+/**
+ * Takes the next recovery step and schedules the next reading.
+ * Every step is tried a few times before escalating, with the backoff doubling on every attempt.
+ * Power cycling is repeated until the sensor is back.
+ */
+void Roode::recover_sensor() {
+  if (recovery_step == RecoveryStep::None ||
+      (recovery_attempts >= recovery_attempts_per_step && recovery_step != RecoveryStep::PowerCycle)) {
+    recovery_step = static_cast<RecoveryStep>(static_cast<uint8_t>(recovery_step) + 1);
+    recovery_attempts = 0;
   }
-  if (presence_sensor != nullptr) {
-    if (CurrentZoneStatus == NOBODY && LeftPreviousStatus == NOBODY && RightPreviousStatus == NOBODY) {
-      // nobody is in the sensing area
-      presence_sensor->publish_state(false);
-    }
+  recovery_attempts++;
+
+  uint32_t backoff = min(recovery_max_backoff_ms, recovery_min_backoff_ms << recovery_backoff_exponent);
+  if (backoff < recovery_max_backoff_ms) {
+    recovery_backoff_exponent++;
   }
+  next_recovery_attempt_ms = millis() + backoff;
+
+  ESP_LOGD(TAG, "Sensor recovery step: %d, attempt: %d, backoff: %ums, errors: %u", (int) recovery_step,
+           recovery_attempts, backoff, total_sensor_errors);
+  switch (recovery_step) {
+    case RecoveryStep::RestartRanging:
+      distanceSensor->restart_ranging();
+      break;
+    case RecoveryStep::Reinit:
+      distanceSensor->reinit();
+      break;
+    case RecoveryStep::PowerCycle:
+      distanceSensor->power_cycle();
+      break;
+    default:
+      break;
+  }
+}
+
+void Roode::path_tracking(Zone *zone) {
+  bool left = zone == (this->invert_direction_ ? &this->exit : &this->entry);
+  bool occupied = Detector::is_occupied(zone->getMinDistance(), zone->threshold);
+  if (occupied) {
+    last_occupied_ms = millis();
+  }
+  tracker.update(left, occupied, zone->getMinDistance(), millis(),
+                 [this](TrackingEvent event, int direction, uint8_t confidence) {
+    static const AcquisitionEvent::Type TYPES[] = {AcquisitionEvent::Presence, AcquisitionEvent::Crossing,
+                                                   AcquisitionEvent::Retraction};
+    this->emit({TYPES[static_cast<uint8_t>(event)], 0, VL53L1_ERROR_NONE, (int8_t) direction, 0, confidence});
+  });
+}
+
+void Roode::publish_event(int direction, uint8_t confidence) {
+  this->updateCounter(direction);
+  CrossingEvent event{};
+  event.direction = direction;
+  event.count = get_count();
+  event.timestamp_ms = millis();
+  event.confidence = confidence;
+  crossing_event_callback.call(event);
+  // kept for existing automations, the triggers don't need to compare strings
+#ifdef USE_TEXT_SENSOR
+  if (entry_exit_event_sensor != nullptr) {
+    entry_exit_event_sensor->publish_state(direction > 0 ? "Entry" : "Exit");
+  }
+#endif
 }
+
+void Roode::log_event(int direction, uint8_t confidence, bool retraction) {
+  if (event_log == nullptr) {
+    return;
+  }
+  event_log->add(direction, get_count(), confidence, retraction);
+}
+
+int16_t Roode::get_count() const {
+#ifdef USE_NUMBER
+  if (people_counter != nullptr && !std::isnan(people_counter->state)) {
+    return people_counter->state;
+  }
+#endif
+  return 0;
+}
+
 void Roode::updateCounter(int delta) {
+  crossing_callback.call(delta);
+#ifdef USE_NUMBER
   if (this->people_counter == nullptr) {
     return;
   }
@@ -186,8 +543,34 @@ void Roode::updateCounter(int delta) {
   auto call = this->people_counter->make_call();
   call.set_value(next);
   call.perform();
+#endif
+}
+void Roode::recalibration() {
+  stop_acquisition();
+  if (power_state != PowerState::Active) {
+    exit_idle();
+  }
+  calibrate_zones();
+  start_acquisition();
+}
+
+/**
+ * Tracks the lowest free heap seen at the end of a loop iteration.
+ * Once booted this should flatline, any downward trend means something is allocating in steady state.
+ */
+void Roode::sample_free_heap() {
+#if defined(USE_ESP32)
+  uint32_t free_heap = heap_caps_get_free_size(MALLOC_CAP_INTERNAL);
+#elif defined(USE_ESP8266)
+  uint32_t free_heap = ESP.getFreeHeap();  // NOLINT(readability-static-accessed-through-instance)
+#else
+  uint32_t free_heap = UINT32_MAX;
+#endif
+  if (free_heap < heap_watermark) {
+    ESP_LOGV(TAG, "New free heap low: %u bytes", free_heap);
+    heap_watermark = free_heap;
+  }
 }
-void Roode::recalibration() { calibrate_zones(); }
 
 const RangingMode *Roode::determine_raning_mode(uint16_t average_entry_zone_distance,
                                                 uint16_t average_exit_zone_distance) {
@@ -196,86 +579,190 @@ const RangingMode *Roode::determine_raning_mode(uint16_t average_entry_zone_dist
   uint16_t max = average_entry_zone_distance > average_exit_zone_distance ? average_entry_zone_distance
                                                                           : average_exit_zone_distance;
   if (min <= short_distance_threshold) {
-    return Ranging::Short;
+    return &Ranging::Short;
   }
   if (max > short_distance_threshold && min <= medium_distance_threshold) {
-    return Ranging::Medium;
+    return &Ranging::Medium;
   }
   if (max > medium_distance_threshold && min <= medium_long_distance_threshold) {
-    return Ranging::Long;
+    return &Ranging::Long;
   }
   if (max > medium_long_distance_threshold && min <= long_distance_threshold) {
-    return Ranging::Longer;
+    return &Ranging::Longer;
   }
-  return Ranging::Longest;
+  return &Ranging::Longest;
 }
 
 void Roode::calibrate_zones() {
   ESP_LOGI(SETUP, "Calibrating sensor zones");
 
-  entry->reset_roi(orientation_ == Parallel ? 167 : 195);
-  exit->reset_roi(orientation_ == Parallel ? 231 : 60);
+  entry.reset_roi(orientation_ == Parallel ? 167 : 195);
+  exit.reset_roi(orientation_ == Parallel ? 231 : 60);
+  calibration_samples[entry.id] = calibration_samples[exit.id] = 0;
 
-  calibrateDistance();
+  bool calibrated = calibrateDistance();
 
-  entry->roi_calibration(entry->threshold->idle, exit->threshold->idle, orientation_);
-  entry->calibrateThreshold(distanceSensor, number_attempts);
-  exit->roi_calibration(entry->threshold->idle, exit->threshold->idle, orientation_);
-  exit->calibrateThreshold(distanceSensor, number_attempts);
+  RoiOptimizer(distanceSensor, orientation_).optimize(entry, exit);
+  calibrated = calibrate_thresholds() && calibrated;
+  ESP_LOGI(SETUP, "Calibration took %u readings of the entry zone and %u of the exit zone",
+           calibration_samples[entry.id], calibration_samples[exit.id]);
 
   publish_sensor_configuration(entry, exit, true);
   App.feed_wdt();
   publish_sensor_configuration(entry, exit, false);
   ESP_LOGI(SETUP, "Finished calibrating sensor zones");
+  if (!calibrated) {
+    ESP_LOGW(SETUP, "Calibration failed for lack of valid readings, not storing it");
+  } else if (persist_calibration_) {
+    save_calibration();
+  }
+}
+
+/**
+ * Hashes everything that influences calibration, so a stored snapshot is only used with the config that produced it.
+ */
+uint32_t Roode::compute_calibration_hash() const {
+  uint32_t hash = fnv1_hash(VERSION);
+  auto add = [&hash](uint32_t value) { hash = (hash * 16777619UL) ^ value; };
+  add(fnv1_hash(object_id_));
+  add(orientation_);
+  add(samples);
+  add(calibration_sampling.tolerance);
+  add(calibration_sampling.min_samples);
+  add(calibration_sampling.max_samples);
+  for (const Zone *zone : {&entry, &exit}) {
+    add(zone->roi_override.width);
+    add(zone->roi_override.height);
+    add(zone->roi_override.center);
+    add(zone->threshold.min);
+    add(zone->threshold.max);
+    add(zone->threshold.min_percentage.value_or(UINT8_MAX));
+    add(zone->threshold.max_percentage.value_or(UINT8_MAX));
+  }
+  auto override = distanceSensor->get_ranging_mode_override();
+  add(override.has_value() ? override.value()->timing_budget : 0);
+  return hash;
 }
 
-void Roode::calibrateDistance() {
-  auto *const initial = distanceSensor->get_ranging_mode_override().value_or(Ranging::Longest);
+bool Roode::restore_calibration() {
+  CalibrationSnapshot snapshot{};
+  if (!calibration_pref_.load(&snapshot) || snapshot.config_hash != calibration_hash_) {
+    ESP_LOGI(SETUP, "No stored calibration found for this configuration");
+    return false;
+  }
+  if (snapshot.ranging_mode >= sizeof(Ranging::All) / sizeof(Ranging::All[0])) {
+    ESP_LOGW(SETUP, "Stored calibration has an invalid ranging mode: %d", snapshot.ranging_mode);
+    return false;
+  }
+
+  distanceSensor->set_ranging_mode(Ranging::All[snapshot.ranging_mode]);
+  entry.restore_calibration(snapshot.entry);
+  exit.restore_calibration(snapshot.exit);
+  if (!entry.verify_calibration(distanceSensor, verification_attempts) ||
+      !exit.verify_calibration(distanceSensor, verification_attempts)) {
+    ESP_LOGW(SETUP, "Stored calibration does not match the current readings, recalibrating");
+    return false;
+  }
+
+  publish_sensor_configuration(entry, exit, true);
+  publish_sensor_configuration(entry, exit, false);
+  ESP_LOGI(SETUP, "Restored stored calibration");
+  return true;
+}
+
+void Roode::save_calibration() {
+  const RangingMode *mode = distanceSensor->get_ranging_mode();
+  if (mode == nullptr) {
+    return;
+  }
+  CalibrationSnapshot snapshot{};
+  snapshot.config_hash = calibration_hash_;
+  const uint8_t modes = sizeof(Ranging::All) / sizeof(Ranging::All[0]);
+  snapshot.ranging_mode = modes;
+  for (uint8_t i = 0; i < modes; i++) {
+    if (*Ranging::All[i] == *mode) {
+      snapshot.ranging_mode = i;
+    }
+  }
+  if (snapshot.ranging_mode == modes) {
+    ESP_LOGW(SETUP, "Ranging mode %s isn't a known one, not storing calibration", mode->name);
+    return;
+  }
+  snapshot.entry = entry.get_calibration();
+  snapshot.exit = exit.get_calibration();
+  if (!calibration_pref_.save(&snapshot)) {
+    ESP_LOGW(SETUP, "Failed to store calibration");
+  }
+}
+
+/** Returns false if a zone couldn't be measured, the ranging mode is left alone then */
+bool Roode::calibrateDistance() {
+  auto *const initial = distanceSensor->get_ranging_mode_override().value_or(&Ranging::Longest);
   distanceSensor->set_ranging_mode(initial);
 
-  entry->calibrateThreshold(distanceSensor, number_attempts);
-  exit->calibrateThreshold(distanceSensor, number_attempts);
+  if (!calibrate_thresholds()) {
+    return false;
+  }
 
   if (distanceSensor->get_ranging_mode_override().has_value()) {
-    return;
+    return true;
   }
-  auto *mode = determine_raning_mode(entry->threshold->idle, exit->threshold->idle);
+  auto *mode = determine_raning_mode(entry.threshold.idle, exit.threshold.idle);
   if (mode != initial) {
     distanceSensor->set_ranging_mode(mode);
   }
+  return true;
+}
+
+/** Returns false if a zone had no valid readings and kept its previous thresholds */
+bool Roode::calibrate_thresholds() {
+  bool calibrated = true;
+  for (Zone *zone : {&entry, &exit}) {
+    uint16_t samples = zone->calibrateThreshold(distanceSensor, calibration_sampling);
+    calibration_samples[zone->id] += samples;
+    calibrated = calibrated && samples > 0;
+  }
+  return calibrated;
 }
 
-void Roode::publish_sensor_configuration(Zone *entry, Zone *exit, bool isMax) {
+void Roode::publish_sensor_configuration(const Zone &entry, const Zone &exit, bool isMax) {
+#ifdef USE_SENSOR
   if (isMax) {
     if (max_threshold_entry_sensor != nullptr) {
-      max_threshold_entry_sensor->publish_state(entry->threshold->max);
+      max_threshold_entry_sensor->publish_state(entry.threshold.max);
     }
 
     if (max_threshold_exit_sensor != nullptr) {
-      max_threshold_exit_sensor->publish_state(exit->threshold->max);
+      max_threshold_exit_sensor->publish_state(exit.threshold.max);
     }
   } else {
     if (min_threshold_entry_sensor != nullptr) {
-      min_threshold_entry_sensor->publish_state(entry->threshold->min);
+      min_threshold_entry_sensor->publish_state(entry.threshold.min);
     }
     if (min_threshold_exit_sensor != nullptr) {
-      min_threshold_exit_sensor->publish_state(exit->threshold->min);
+      min_threshold_exit_sensor->publish_state(exit.threshold.min);
     }
   }
 
   if (entry_roi_height_sensor != nullptr) {
-    entry_roi_height_sensor->publish_state(entry->roi->height);
+    entry_roi_height_sensor->publish_state(entry.roi.height);
   }
   if (entry_roi_width_sensor != nullptr) {
-    entry_roi_width_sensor->publish_state(entry->roi->width);
+    entry_roi_width_sensor->publish_state(entry.roi.width);
   }
 
   if (exit_roi_height_sensor != nullptr) {
-    exit_roi_height_sensor->publish_state(exit->roi->height);
+    exit_roi_height_sensor->publish_state(exit.roi.height);
   }
   if (exit_roi_width_sensor != nullptr) {
-    exit_roi_width_sensor->publish_state(exit->roi->width);
+    exit_roi_width_sensor->publish_state(exit.roi.width);
+  }
+  for (const Zone *zone : {&entry, &exit}) {
+    if (calibration_samples_sensors[zone->id] != nullptr) {
+      calibration_samples_sensors[zone->id]->publish_state(calibration_samples[zone->id]);
+    }
   }
+#endif
 }
 }  // namespace roode
 }  // namespace esphome
\ No newline at end of file
@@ -1,23 +1,49 @@
 #pragma once
 #include <math.h>
+#include <algorithm>
 
-#include "esphome/components/binary_sensor/binary_sensor.h"
-#include "esphome/components/sensor/sensor.h"
-#include "esphome/components/text_sensor/text_sensor.h"
 #include "esphome/core/application.h"
 #include "esphome/core/component.h"
+#include "esphome/core/defines.h"
+#include "esphome/core/helpers.h"
 #include "esphome/core/log.h"
+#include "esphome/core/preferences.h"
 #include "../vl53l1x/vl53l1x.h"
+#ifdef USE_SENSOR
+#include "esphome/components/sensor/sensor.h"
+#endif
+#ifdef USE_BINARY_SENSOR
+#include "esphome/components/binary_sensor/binary_sensor.h"
+#endif
+#ifdef USE_TEXT_SENSOR
+#include "esphome/components/text_sensor/text_sensor.h"
+#endif
+#ifdef USE_NUMBER
+#include "esphome/components/number/number.h"
+#endif
+#ifdef USE_ESP32
+#include <driver/gpio.h>
+#include <esp_heap_caps.h>
+#include <esp_sleep.h>
+#endif
+#ifdef USE_ESP8266
+#include <Esp.h>
+#endif
+#include "event_log.h"
 #include "orientation.h"
+#include "raw_stream.h"
+#include "roi_optimizer.h"
 #include "zone.h"
+#ifdef USE_ROODE_ACQUISITION_TASK
+#include "acquisition_task.h"
+#include "spsc_queue.h"
+#endif
 
 using namespace esphome::vl53l1x;
 using TofSensor = esphome::vl53l1x::VL53L1X;
 
 namespace esphome {
 namespace roode {
-#define NOBODY 0
-#define SOMEONE 1
 #define VERSION "1.5.1"
 static const char *const TAG = "Roode";
 static const char *const SETUP = "Setup";
@@ -52,12 +78,82 @@ static int time_budget_in_ms_medium_long = 50;
 static int time_budget_in_ms_long = 100;
 static int time_budget_in_ms_max = 200;  // max range: 4m
 
+/** Escalating steps taken to get a failing sensor to range again */
+enum class RecoveryStep : uint8_t { None, Retry, RestartRanging, Reinit, PowerCycle };
+/** ULD error codes go down to VL53L1_ERROR_CONTROL_INTERFACE (-13), anything beyond is counted in the last slot */
+static const uint8_t SENSOR_ERROR_CODES = 15;
+
+/** Whether both zones are ranged, or the sensor watches the doorway by itself while the MCU may sleep */
+enum class PowerState : uint8_t { Active, Idle, Sleeping };
+static const uint8_t POWER_STATES = 3;
+
+/**
+ * Nominal supply currents in mA for the energy estimate, from the ESP32 & VL53L1X datasheets.
+ * The MCU figures are the ESP32's only, other platforms are estimated as if they were one.
+ * The sensor draws its ranging current for the timing budget of every measurement and idles in between.
+ */
+static const float MCU_ACTIVE_MA = 40;
+static const float MCU_LIGHT_SLEEP_MA = 0.8f;
+static const float SENSOR_RANGING_MA = 16;
+static const float SENSOR_STANDBY_MA = 0.005f;
+static const float SUPPLY_VOLTAGE = 3.3f;
+
+/**
+ * Everything acquisition hands over to the main loop for publishing.
+ * Without the acquisition task these are handled right away.
+ */
+struct AcquisitionEvent {
+  enum Type : uint8_t {
+    /** A zone reading, with `value` the time it was taken in µs */
+    Sample,
+    /** Someone entered or everybody left the zones, `direction` is 1 or 0 */
+    Presence,
+    /** An entry (`direction` 1) or exit (-1), with `value` the confidence in percent */
+    Crossing,
+    /** Undo a provisional crossing in `direction` */
+    Retraction,
+    /** The sensor status changed or a reading failed, with `value` the total number of errors */
+    SensorStatus,
+    /** The sensor works again after `value` ms */
+    SensorRecovered,
+    /** Switched to the power state in `zone`, after `value` ms in the one in `direction` */
+    PowerStateChange,
+  };
+  Type type;
+  uint8_t zone;
+  VL53L1_Error status;
+  int8_t direction;
+  uint16_t distance;
+  uint32_t value;
+};
+
+/** An entry or exit as handed to automations, see CrossingTrigger */
+struct CrossingEvent {
+  /** 1 for an entry, -1 for an exit */
+  int8_t direction;
+  /** People count after the crossing, 0 without a people counter */
+  int16_t count;
+  /** When the main loop handled the crossing, in ms since boot */
+  uint32_t timestamp_ms;
+  /** How sure the tracker is, in percent */
+  uint8_t confidence;
+};
+
+/** Everything needed to skip calibration on boot. Stored keyed by the hash of the configuration it was made with. */
+struct CalibrationSnapshot {
+  uint32_t config_hash;
+  uint8_t ranging_mode;
+  ZoneCalibration entry;
+  ZoneCalibration exit;
+};
+
 class Roode : public PollingComponent {
  public:
   void setup() override;
   void update() override;
   void loop() override;
   void dump_config() override;
+  void on_shutdown() override;
   /** Roode uses data from sensors */
   float get_setup_priority() const override { return setup_priority::PROCESSOR; };
 
@@ -65,14 +161,26 @@ class Roode : public PollingComponent {
   void set_tof_sensor(TofSensor *sensor) { this->distanceSensor = sensor; }
   void set_invert_direction(bool dir) { invert_direction_ = dir; }
   void set_orientation(Orientation val) { orientation_ = val; }
+  void set_persist_calibration(bool val) { persist_calibration_ = val; }
+  /** Tells instances apart, so each one keeps a calibration of its own */
+  void set_object_id(const char *id) { object_id_ = id; }
+  void set_raw_stream(RawStream *stream) { raw_stream = stream; }
+  void set_event_log(EventLog *log) { event_log = log; }
+#ifdef USE_ROODE_ACQUISITION_TASK
+  void set_acquisition_task(bool val) { use_acquisition_task_ = val; }
+#endif
+  void set_idle_after(uint32_t ms) { idle_after_ms = ms; }
+  void set_idle_interval(uint32_t ms) { idle_interval_ms = ms; }
+  void set_light_sleep(uint32_t ms) { light_sleep_ms = ms; }
   void set_sampling_size(uint8_t size) {
     samples = size;
-    entry->set_max_samples(size);
-    exit->set_max_samples(size);
+    entry.set_max_samples(size);
+    exit.set_max_samples(size);
   }
+  // Entities only exist if their domain is part of the build, otherwise the code publishing them compiles away
+#ifdef USE_SENSOR
   void set_distance_entry(sensor::Sensor *distance_entry_) { distance_entry = distance_entry_; }
   void set_distance_exit(sensor::Sensor *distance_exit_) { distance_exit = distance_exit_; }
-  void set_people_counter(number::Number *counter) { this->people_counter = counter; }
   void set_max_threshold_entry_sensor(sensor::Sensor *max_threshold_entry_sensor_) {
     max_threshold_entry_sensor = max_threshold_entry_sensor_;
   }
@@ -90,53 +198,187 @@ class Roode : public PollingComponent {
   void set_exit_roi_height_sensor(sensor::Sensor *roi_height_sensor_) { exit_roi_height_sensor = roi_height_sensor_; }
   void set_exit_roi_width_sensor(sensor::Sensor *roi_width_sensor_) { exit_roi_width_sensor = roi_width_sensor_; }
   void set_sensor_status_sensor(sensor::Sensor *status_sensor_) { status_sensor = status_sensor_; }
+  void set_sensor_errors_sensor(sensor::Sensor *sensor_errors_sensor_) { sensor_errors_sensor = sensor_errors_sensor_; }
+  void set_recovery_time_sensor(sensor::Sensor *recovery_time_sensor_) { recovery_time_sensor = recovery_time_sensor_; }
+  void set_heap_watermark_sensor(sensor::Sensor *heap_watermark_sensor_) {
+    heap_watermark_sensor = heap_watermark_sensor_;
+  }
+  void set_active_time_sensor(sensor::Sensor *sensor_) { power_state_sensors[(uint8_t) PowerState::Active] = sensor_; }
+  void set_idle_time_sensor(sensor::Sensor *sensor_) { power_state_sensors[(uint8_t) PowerState::Idle] = sensor_; }
+  void set_sleep_time_sensor(sensor::Sensor *sensor_) { power_state_sensors[(uint8_t) PowerState::Sleeping] = sensor_; }
+  void set_energy_per_hour_sensor(sensor::Sensor *sensor_) { energy_per_hour_sensor = sensor_; }
+  void set_calibration_samples_entry_sensor(sensor::Sensor *sensor_) { calibration_samples_sensors[0] = sensor_; }
+  void set_calibration_samples_exit_sensor(sensor::Sensor *sensor_) { calibration_samples_sensors[1] = sensor_; }
+#endif
+#ifdef USE_BINARY_SENSOR
   void set_presence_sensor_binary_sensor(binary_sensor::BinarySensor *presence_sensor_) {
     presence_sensor = presence_sensor_;
   }
+#endif
+#ifdef USE_TEXT_SENSOR
   void set_version_text_sensor(text_sensor::TextSensor *version_sensor_) { version_sensor = version_sensor_; }
   void set_entry_exit_event_text_sensor(text_sensor::TextSensor *entry_exit_event_sensor_) {
     entry_exit_event_sensor = entry_exit_event_sensor_;
   }
+#endif
+#ifdef USE_NUMBER
+  void set_people_counter(number::Number *counter) { this->people_counter = counter; }
+#endif
+  /**
+   * Called for every change of the people count by a crossing: 1 for an entry, -1 for an exit,
+   * and the opposite direction when a provisional crossing is retracted.
+   */
+  void add_on_crossing_callback(std::function<void(int)> &&callback) { crossing_callback.add(std::move(callback)); }
+  /** Called for every entry & exit, after the people count was updated. Retractions aren't reported. */
+  void add_on_crossing_event_callback(std::function<void(const CrossingEvent &)> &&callback) {
+    crossing_event_callback.add(std::move(callback));
+  }
   void recalibration();
-  Zone *entry = new Zone(0);
-  Zone *exit = new Zone(1);
+  /** Number of failed readings with the given status since boot */
+  uint32_t get_sensor_error_count(VL53L1_Error status) const { return sensor_errors[error_index(status)]; }
+  /** Time spent in the given power state since boot, as seen by the main loop */
+  uint64_t get_power_state_time(PowerState state) const;
+  /** Estimated average consumption since boot in mW, which is the energy per hour in mWh */
+  float get_energy_per_hour() const;
+  Zone entry{0};
+  Zone exit{1};
+  CalibrationSampling calibration_sampling{};
 
  protected:
   TofSensor *distanceSensor;
-  Zone *current_zone = entry;
-  sensor::Sensor *distance_entry;
-  sensor::Sensor *distance_exit;
-  number::Number *people_counter;
-  sensor::Sensor *max_threshold_entry_sensor;
-  sensor::Sensor *max_threshold_exit_sensor;
-  sensor::Sensor *min_threshold_entry_sensor;
-  sensor::Sensor *min_threshold_exit_sensor;
-  sensor::Sensor *exit_roi_height_sensor;
-  sensor::Sensor *exit_roi_width_sensor;
-  sensor::Sensor *entry_roi_height_sensor;
-  sensor::Sensor *entry_roi_width_sensor;
-  sensor::Sensor *status_sensor;
-  binary_sensor::BinarySensor *presence_sensor;
-  text_sensor::TextSensor *version_sensor;
-  text_sensor::TextSensor *entry_exit_event_sensor;
+  Zone *current_zone = &entry;
+#ifdef USE_SENSOR
+  sensor::Sensor *distance_entry{nullptr};
+  sensor::Sensor *distance_exit{nullptr};
+  sensor::Sensor *max_threshold_entry_sensor{nullptr};
+  sensor::Sensor *max_threshold_exit_sensor{nullptr};
+  sensor::Sensor *min_threshold_entry_sensor{nullptr};
+  sensor::Sensor *min_threshold_exit_sensor{nullptr};
+  sensor::Sensor *exit_roi_height_sensor{nullptr};
+  sensor::Sensor *exit_roi_width_sensor{nullptr};
+  sensor::Sensor *entry_roi_height_sensor{nullptr};
+  sensor::Sensor *entry_roi_width_sensor{nullptr};
+  sensor::Sensor *status_sensor{nullptr};
+  sensor::Sensor *sensor_errors_sensor{nullptr};
+  sensor::Sensor *recovery_time_sensor{nullptr};
+  sensor::Sensor *heap_watermark_sensor{nullptr};
+  sensor::Sensor *power_state_sensors[POWER_STATES] = {};
+  sensor::Sensor *energy_per_hour_sensor{nullptr};
+  sensor::Sensor *calibration_samples_sensors[2] = {};
+#endif
+#ifdef USE_BINARY_SENSOR
+  binary_sensor::BinarySensor *presence_sensor{nullptr};
+#endif
+#ifdef USE_TEXT_SENSOR
+  text_sensor::TextSensor *version_sensor{nullptr};
+  text_sensor::TextSensor *entry_exit_event_sensor{nullptr};
+#endif
+#ifdef USE_NUMBER
+  number::Number *people_counter{nullptr};
+#endif
+  RawStream *raw_stream{nullptr};
+  EventLog *event_log{nullptr};
+  CallbackManager<void(int)> crossing_callback;
+  CallbackManager<void(const CrossingEvent &)> crossing_event_callback;
 
   VL53L1_Error last_sensor_status = VL53L1_ERROR_NONE;
-  VL53L1_Error sensor_status = VL53L1_ERROR_NONE;
+  uint32_t sensor_errors[SENSOR_ERROR_CODES] = {};
+  uint32_t total_sensor_errors{0};
+  RecoveryStep recovery_step{RecoveryStep::None};
+  /** Attempts made at the current recovery step */
+  uint8_t recovery_attempts{0};
+  /** Attempts made since the sensor started failing, which determines the backoff */
+  uint8_t recovery_backoff_exponent{0};
+  uint32_t failing_since_ms{0};
+  uint32_t next_recovery_attempt_ms{0};
+  uint8_t recovery_attempts_per_step = 2;
+  uint32_t recovery_min_backoff_ms = 10;
+  uint32_t recovery_max_backoff_ms = 30000;
+  Tracker tracker{};
+  Scheduler scheduler{};
+  /** Last reading per zone, as seen by the main loop */
+  uint16_t distances[2] = {};
+  /** Nobody in either zone for this long hands watching the doorway over to the sensor, 0 to always range */
+  uint32_t idle_after_ms{0};
+  /**
+   * Time between the sensor's measurements while idle, and between checks without an interrupt pin. 0 keeps the rate
+   * of the ranging mode, anything slower risks noticing people too late to see them enter the first zone.
+   */
+  uint32_t idle_interval_ms{0};
+  /** Longest the MCU light sleeps at a time while idle, 0 to stay awake */
+  uint32_t light_sleep_ms{0};
+  /** Power state as seen by acquisition */
+  PowerState power_state{PowerState::Active};
+  uint32_t power_state_since_ms{0};
+  uint32_t last_occupied_ms{0};
+  uint32_t last_presence_check_ms{0};
+  /** Time spent in each power state as seen by the main loop, not counting the current one */
+  uint64_t power_state_ms[POWER_STATES] = {};
+  PowerState reported_power_state{PowerState::Active};
+  uint32_t reported_power_state_since_ms{0};
+  bool acquire();
+  void enter_idle();
+  bool wait_for_presence();
+  VL53L1_Error exit_idle();
+  void seed_tracker();
+  void light_sleep();
+  uint32_t idle_measurement_interval() const;
+  void set_power_state(PowerState state);
+  void emit(const AcquisitionEvent &event);
+  void handle_event(const AcquisitionEvent &event);
+#ifdef USE_ROODE_ACQUISITION_TASK
+  static void acquisition_loop(void *roode);
+  void handle_queued_events();
+#endif
+  void start_acquisition();
+  void stop_acquisition();
   void path_tracking(Zone *zone);
-  bool handle_sensor_status();
-  void calibrateDistance();
+  void publish_event(int direction, uint8_t confidence);
+  int16_t get_count() const;
+  void log_event(int direction, uint8_t confidence, bool retraction);
+  bool handle_sensor_status(VL53L1_Error status);
+  void recover_sensor();
+  static uint8_t error_index(VL53L1_Error status) {
+    return status >= 0 ? 0 : std::min<int>(-status, SENSOR_ERROR_CODES - 1);
+  }
+  bool calibrateDistance();
+  bool calibrate_thresholds();
   void calibrate_zones();
+  uint32_t compute_calibration_hash() const;
+  bool restore_calibration();
+  void save_calibration();
   const RangingMode *determine_raning_mode(uint16_t average_entry_zone_distance, uint16_t average_exit_zone_distance);
-  void publish_sensor_configuration(Zone *entry, Zone *exit, bool isMax);
+  void publish_sensor_configuration(const Zone &entry, const Zone &exit, bool isMax);
   void updateCounter(int delta);
+  void sample_free_heap();
   Orientation orientation_{Parallel};
   uint8_t samples{2};
   bool invert_direction_{false};
-  int number_attempts = 20;  // TO DO: make this configurable
+  bool persist_calibration_{true};
+  /** Whether events go through the queue, only changed while the task is stopped */
+  bool queue_events{false};
+#ifdef USE_ROODE_ACQUISITION_TASK
+  // only built in when a roode config enables the task, the queues take about 1KB of RAM
+  bool use_acquisition_task_{false};
+  AcquisitionTask acquisition_task{acquisition_loop, this};
+  /** Readings, dropped while the main loop lags behind as the next ones supersede them */
+  SpscQueue<AcquisitionEvent, 64> samples_queue{};
+  /** Everything else, which changes the count or accumulated state, so acquisition waits for room instead */
+  SpscQueue<AcquisitionEvent, 32> control_queue{};
+#endif
+  const char *object_id_{""};
+  uint32_t calibration_hash_{};
+  ESPPreferenceObject calibration_pref_;
+  /** Readings per zone taken by the last calibration, over all ranging modes tried */
+  uint16_t calibration_samples[2] = {};
+  /** Live readings per zone used to check a restored calibration */
+  int verification_attempts = 3;
   int short_distance_threshold = 1300;
   int medium_distance_threshold = 2000;
   int medium_long_distance_threshold = 2700;
   int long_distance_threshold = 3400;
+  /** Lowest amount of free heap seen while looping */
+  uint32_t heap_watermark{UINT32_MAX};
 };
 
 }  // namespace roode
@@ -4,9 +4,12 @@ from esphome.components import sensor
 from esphome.const import (
     ICON_ARROW_EXPAND_VERTICAL,
     ICON_NEW_BOX,
+    ICON_TIMER,
     ICON_RULER,
     STATE_CLASS_MEASUREMENT,
+    STATE_CLASS_TOTAL_INCREASING,
     UNIT_EMPTY,
+    UNIT_SECOND,
     ENTITY_CATEGORY_DIAGNOSTIC,
 )
 from . import Roode, CONF_ROODE_ID
@@ -24,6 +27,15 @@ CONF_ROI_WIDTH_entry = "roi_width_entry"
 CONF_ROI_HEIGHT_exit = "roi_height_exit"
 CONF_ROI_WIDTH_exit = "roi_width_exit"
 SENSOR_STATUS = "sensor_status"
+HEAP_WATERMARK = "heap_watermark"
+SENSOR_ERRORS = "sensor_errors"
+RECOVERY_TIME = "recovery_time"
+ACTIVE_TIME = "active_time"
+IDLE_TIME = "idle_time"
+SLEEP_TIME = "sleep_time"
+ENERGY_PER_HOUR = "energy_per_hour"
+CALIBRATION_SAMPLES_entry = "calibration_samples_entry"
+CALIBRATION_SAMPLES_exit = "calibration_samples_exit"
 
 CONFIG_SCHEMA = sensor.sensor_schema().extend(
     {
@@ -102,6 +114,66 @@ CONFIG_SCHEMA = sensor.sensor_schema().extend(
             accuracy_decimals=0,
             entity_category=ENTITY_CATEGORY_DIAGNOSTIC,
         ),
+        cv.Optional(HEAP_WATERMARK): sensor.sensor_schema(
+            icon="mdi:memory",
+            unit_of_measurement="B",
+            accuracy_decimals=0,
+            state_class=STATE_CLASS_MEASUREMENT,
+            entity_category=ENTITY_CATEGORY_DIAGNOSTIC,
+        ),
+        cv.Optional(SENSOR_ERRORS): sensor.sensor_schema(
+            icon="mdi:alert-circle",
+            accuracy_decimals=0,
+            state_class=STATE_CLASS_TOTAL_INCREASING,
+            entity_category=ENTITY_CATEGORY_DIAGNOSTIC,
+        ),
+        cv.Optional(RECOVERY_TIME): sensor.sensor_schema(
+            icon="mdi:timer-refresh",
+            unit_of_measurement="ms",
+            accuracy_decimals=0,
+            state_class=STATE_CLASS_MEASUREMENT,
+            entity_category=ENTITY_CATEGORY_DIAGNOSTIC,
+        ),
+        cv.Optional(ACTIVE_TIME): sensor.sensor_schema(
+            icon=ICON_TIMER,
+            unit_of_measurement=UNIT_SECOND,
+            accuracy_decimals=0,
+            state_class=STATE_CLASS_TOTAL_INCREASING,
+            entity_category=ENTITY_CATEGORY_DIAGNOSTIC,
+        ),
+        cv.Optional(IDLE_TIME): sensor.sensor_schema(
+            icon=ICON_TIMER,
+            unit_of_measurement=UNIT_SECOND,
+            accuracy_decimals=0,
+            state_class=STATE_CLASS_TOTAL_INCREASING,
+            entity_category=ENTITY_CATEGORY_DIAGNOSTIC,
+        ),
+        cv.Optional(SLEEP_TIME): sensor.sensor_schema(
+            icon="mdi:sleep",
+            unit_of_measurement=UNIT_SECOND,
+            accuracy_decimals=0,
+            state_class=STATE_CLASS_TOTAL_INCREASING,
+            entity_category=ENTITY_CATEGORY_DIAGNOSTIC,
+        ),
+        cv.Optional(ENERGY_PER_HOUR): sensor.sensor_schema(
+            icon="mdi:lightning-bolt",
+            unit_of_measurement="mWh",
+            accuracy_decimals=1,
+            state_class=STATE_CLASS_MEASUREMENT,
+            entity_category=ENTITY_CATEGORY_DIAGNOSTIC,
+        ),
+        cv.Optional(CALIBRATION_SAMPLES_entry): sensor.sensor_schema(
+            icon="mdi:counter",
+            accuracy_decimals=0,
+            state_class=STATE_CLASS_MEASUREMENT,
+            entity_category=ENTITY_CATEGORY_DIAGNOSTIC,
+        ),
+        cv.Optional(CALIBRATION_SAMPLES_exit): sensor.sensor_schema(
+            icon="mdi:counter",
+            accuracy_decimals=0,
+            state_class=STATE_CLASS_MEASUREMENT,
+            entity_category=ENTITY_CATEGORY_DIAGNOSTIC,
+        ),
         cv.GenerateID(CONF_ROODE_ID): cv.use_id(Roode),
     }
 )
@@ -142,3 +214,30 @@ async def to_code(config):
     if SENSOR_STATUS in config:
         count = await sensor.new_sensor(config[SENSOR_STATUS])
         cg.add(var.set_sensor_status_sensor(count))
+    if HEAP_WATERMARK in config:
+        count = await sensor.new_sensor(config[HEAP_WATERMARK])
+        cg.add(var.set_heap_watermark_sensor(count))
+    if SENSOR_ERRORS in config:
+        count = await sensor.new_sensor(config[SENSOR_ERRORS])
+        cg.add(var.set_sensor_errors_sensor(count))
+    if RECOVERY_TIME in config:
+        count = await sensor.new_sensor(config[RECOVERY_TIME])
+        cg.add(var.set_recovery_time_sensor(count))
+    if ACTIVE_TIME in config:
+        time = await sensor.new_sensor(config[ACTIVE_TIME])
+        cg.add(var.set_active_time_sensor(time))
+    if IDLE_TIME in config:
+        time = await sensor.new_sensor(config[IDLE_TIME])
+        cg.add(var.set_idle_time_sensor(time))
+    if SLEEP_TIME in config:
+        time = await sensor.new_sensor(config[SLEEP_TIME])
+        cg.add(var.set_sleep_time_sensor(time))
+    if ENERGY_PER_HOUR in config:
+        energy = await sensor.new_sensor(config[ENERGY_PER_HOUR])
+        cg.add(var.set_energy_per_hour_sensor(energy))
+    if CALIBRATION_SAMPLES_entry in config:
+        count = await sensor.new_sensor(config[CALIBRATION_SAMPLES_entry])
+        cg.add(var.set_calibration_samples_entry_sensor(count))
+    if CALIBRATION_SAMPLES_exit in config:
+        count = await sensor.new_sensor(config[CALIBRATION_SAMPLES_exit])
+        cg.add(var.set_calibration_samples_exit_sensor(count))
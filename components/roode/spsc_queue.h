@@ -0,0 +1,58 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace esphome {
+namespace roode {
+
+/**
+ * Lock-free queue for exactly one producer and one consumer thread.
+ * Items pushed while the queue is full are dropped and counted, the producer never waits for the consumer.
+ */
+template<typename T, size_t N> class SpscQueue {
+  static_assert(N > 0 && (N & (N - 1)) == 0, "capacity must be a power of two");
+
+ public:
+  /** Producer only */
+  bool push(const T &item) {
+    uint32_t head = this->head.load(std::memory_order_relaxed);
+    if (head - this->tail.load(std::memory_order_acquire) >= N) {
+      this->dropped.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+    this->buffer[head & (N - 1)] = item;
+    this->head.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  /** Producer only, a consumer may make room at any time */
+  bool is_full() const {
+    return this->head.load(std::memory_order_relaxed) - this->tail.load(std::memory_order_acquire) >= N;
+  }
+
+  /** Consumer only */
+  bool pop(T &item) {
+    uint32_t tail = this->tail.load(std::memory_order_relaxed);
+    if (tail == this->head.load(std::memory_order_acquire)) {
+      return false;
+    }
+    item = this->buffer[tail & (N - 1)];
+    this->tail.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  /** Number of items dropped because the queue was full */
+  uint32_t get_dropped() const { return this->dropped.load(std::memory_order_relaxed); }
+
+ protected:
+  std::array<T, N> buffer{};
+  /** Free running counters, only their difference matters */
+  std::atomic<uint32_t> head{0};
+  std::atomic<uint32_t> tail{0};
+  std::atomic<uint32_t> dropped{0};
+};
+
+}  // namespace roode
+}  // namespace esphome
@@ -0,0 +1,60 @@
+import esphome.codegen as cg
+import esphome.config_validation as cv
+import esphome.final_validate as fv
+from esphome.components import switch
+from esphome.const import (
+    CONF_ID,
+    CONF_ICON,
+    CONF_ENTITY_CATEGORY,
+    ENTITY_CATEGORY_CONFIG,
+)
+from esphome.core import CORE
+from . import Roode, CONF_ROODE_ID, CONF_RAW_STREAM, roode_ns
+
+DEPENDENCIES = ["roode"]
+
+RawStreamSwitch = roode_ns.class_("RawStreamSwitch", switch.Switch, cg.Component)
+
+CONFIG_SCHEMA = cv.Schema(
+    {
+        cv.GenerateID(CONF_ROODE_ID): cv.use_id(Roode),
+        cv.Optional(CONF_RAW_STREAM): switch.SWITCH_SCHEMA.extend(
+            {
+                cv.GenerateID(): cv.declare_id(RawStreamSwitch),
+                cv.Optional(CONF_ICON, default="mdi:chart-line"): cv.icon,
+                cv.Optional(
+                    CONF_ENTITY_CATEGORY, default=ENTITY_CATEGORY_CONFIG
+                ): cv.entity_category,
+            }
+        ).extend(cv.COMPONENT_SCHEMA),
+    }
+)
+
+
+def find_raw_stream(full_config, roode_id):
+    for conf in full_config["roode"]:
+        if conf[CONF_ID] == roode_id:
+            return conf.get(CONF_RAW_STREAM)
+    return None
+
+
+def validate_raw_stream(config):
+    if CONF_RAW_STREAM in config and find_raw_stream(fv.full_config.get(), config[CONF_ROODE_ID]) is None:
+        raise cv.Invalid(
+            "The raw stream switch needs raw_stream to be configured in roode"
+        )
+    return config
+
+
+FINAL_VALIDATE_SCHEMA = validate_raw_stream
+
+
+async def to_code(config):
+    if CONF_RAW_STREAM in config:
+        conf = config[CONF_RAW_STREAM]
+        var = cg.new_Pvariable(conf[CONF_ID])
+        await cg.register_component(var, conf)
+        await switch.register_switch(var, conf)
+        stream_config = find_raw_stream(CORE.config, config[CONF_ROODE_ID])
+        stream = await cg.get_variable(stream_config[CONF_ID])
+        cg.add(var.set_raw_stream(stream))
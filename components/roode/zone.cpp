@@ -5,10 +5,19 @@ namespace roode {
 
 void Zone::dump_config() const {
   ESP_LOGCONFIG(TAG, "   %s", id == 0U ? "Entry" : "Exit");
-  ESP_LOGCONFIG(TAG, "     ROI: { width: %d, height: %d, center: %d }", roi->width, roi->height, roi->center);
-  ESP_LOGCONFIG(TAG, "     Threshold: { min: %dmm (%d%%), max: %dmm (%d%%), idle: %dmm }", threshold->min,
-                threshold->min_percentage.value_or((threshold->min * 100) / threshold->idle), threshold->max,
-                threshold->max_percentage.value_or((threshold->max * 100) / threshold->idle), threshold->idle);
+  ESP_LOGCONFIG(TAG, "     ROI: { width: %d, height: %d, center: %d }", roi.width, roi.height, roi.center);
+  if (threshold.idle == 0) {
+    // a failed calibration leaves nothing to base the percentages on
+    ESP_LOGCONFIG(TAG, "     Threshold: uncalibrated");
+    return;
+  }
+  // not value_or, which would work out the fallback even when a percentage is configured
+  int min_percentage = threshold.min_percentage.has_value() ? threshold.min_percentage.value()
+                                                             : (threshold.min * 100) / threshold.idle;
+  int max_percentage = threshold.max_percentage.has_value() ? threshold.max_percentage.value()
+                                                             : (threshold.max * 100) / threshold.idle;
+  ESP_LOGCONFIG(TAG, "     Threshold: { min: %dmm (%d%%), max: %dmm (%d%%), idle: %dmm }", threshold.min,
+                min_percentage, threshold.max, max_percentage, threshold.idle);
 }
 
 VL53L1_Error Zone::readDistance(TofSensor *distanceSensor) {
@@ -20,11 +29,7 @@ VL53L1_Error Zone::readDistance(TofSensor *distanceSensor) {
   }
 
   last_distance = result.value();
-  samples.insert(samples.begin(), result.value());
-  if (samples.size() > max_samples) {
-    samples.pop_back();
-  };
-  min_distance = *std::min_element(samples.begin(), samples.end());
+  filtered_distance = filter.update(result.value());
 
   return sensor_status;
 }
@@ -34,99 +39,113 @@ VL53L1_Error Zone::readDistance(TofSensor *distanceSensor) {
  * This is needed to do initial calibration of thresholds & ROI.
  */
 void Zone::reset_roi(uint8_t default_center) {
-  roi->width = roi_override->width ?: 6;
-  roi->height = roi_override->height ?: 16;
-  roi->center = roi_override->center ?: default_center;
-  ESP_LOGD(TAG, "%s ROI reset: { width: %d, height: %d, center: %d }", id == 0U ? "Entry" : "Exit", roi->width,
-           roi->height, roi->center);
+  roi.width = roi_override.width ?: 6;
+  roi.height = roi_override.height ?: 16;
+  roi.center = roi_override.center ?: default_center;
+  ESP_LOGD(TAG, "%s ROI reset: { width: %d, height: %d, center: %d }", id == 0U ? "Entry" : "Exit", roi.width,
+           roi.height, roi.center);
 }
 
-void Zone::calibrateThreshold(TofSensor *distanceSensor, int number_attempts) {
+/**
+ * Averages readings of the empty zone until the mean is precise enough: a quiet zone is done after a few readings,
+ * a noisy one gets more. Failed readings are skipped, but count towards the maximum.
+ * The variance is kept with Welford's method, squared distances of a few metres add up beyond a float's precision.
+ */
+uint16_t Zone::calibrateThreshold(TofSensor *distanceSensor, const CalibrationSampling &sampling) {
   ESP_LOGD(CALIBRATION, "Beginning. zoneId: %d", id);
-  int *zone_distances = new int[number_attempts];
-  int sum = 0;
-  for (int i = 0; i < number_attempts; i++) {
-    this->readDistance(distanceSensor);
-    zone_distances[i] = this->getDistance();
-    sum += zone_distances[i];
-  };
-  threshold->idle = this->getOptimizedValues(zone_distances, sum, number_attempts);
+  double mean = 0;
+  // sum of squared differences from the mean
+  double m2 = 0;
+  uint16_t samples = 0;
+  for (uint16_t attempts = 0; attempts < sampling.max_samples; attempts++) {
+    auto status = this->readDistance(distanceSensor);
+    App.feed_wdt();
+    if (status != VL53L1_ERROR_NONE) {
+      continue;
+    }
+    double distance = this->getDistance();
+    samples++;
+    double delta = distance - mean;
+    mean += delta / samples;
+    m2 += delta * (distance - mean);
+    if (samples >= std::max<uint16_t>(sampling.min_samples, 2)) {
+      // half width of the 95% confidence interval of the mean, from the sample variance
+      double margin = 1.96 * sqrt(m2 / (samples - 1) / samples);
+      if (margin <= sampling.tolerance) {
+        break;
+      }
+    }
+  }
+  if (samples == 0) {
+    ESP_LOGW(CALIBRATION, "No valid readings. zoneId: %d", id);
+    return 0;
+  }
+  threshold.idle = this->getOptimizedValues(mean, m2, samples);
 
-  if (threshold->max_percentage.has_value()) {
-    threshold->max = (threshold->idle * threshold->max_percentage.value()) / 100;
+  if (threshold.max_percentage.has_value()) {
+    threshold.max = (threshold.idle * threshold.max_percentage.value()) / 100;
   }
-  if (threshold->min_percentage.has_value()) {
-    threshold->min = (threshold->idle * threshold->min_percentage.value()) / 100;
+  if (threshold.min_percentage.has_value()) {
+    threshold.min = (threshold.idle * threshold.min_percentage.value()) / 100;
   }
-  ESP_LOGI(CALIBRATION, "Calibrated threshold for zone. zoneId: %d, idle: %d, min: %d (%d%%), max: %d (%d%%)", id,
-           threshold->idle, threshold->min,
-           threshold->min_percentage.value_or((threshold->min * 100) / threshold->idle), threshold->max,
-           threshold->max_percentage.value_or((threshold->max * 100) / threshold->idle));
+  ESP_LOGI(CALIBRATION,
+           "Calibrated threshold for zone. zoneId: %d, idle: %d, min: %d (%d%%), max: %d (%d%%), samples: %d", id,
+           threshold.idle, threshold.min, threshold.min_percentage.value_or((threshold.min * 100) / threshold.idle),
+           threshold.max, threshold.max_percentage.value_or((threshold.max * 100) / threshold.idle), samples);
+  return samples;
 }
 
-void Zone::roi_calibration(uint16_t entry_threshold, uint16_t exit_threshold, Orientation orientation) {
-  // the value of the average distance is used for computing the optimal size of the ROI and consequently also the
-  // center of the two zones
-  int function_of_the_distance = 16 * (1 - (0.15 * 2) / (0.34 * (min(entry_threshold, exit_threshold) / 1000)));
-  int ROI_size = min(8, max(4, function_of_the_distance));
-  this->roi->width = this->roi_override->width ?: ROI_size;
-  this->roi->height = this->roi_override->height ?: ROI_size * 2;
-  if (this->roi_override->center) {
-    this->roi->center = this->roi_override->center;
-  } else {
-    // now we set the position of the center of the two zones
-    if (orientation == Parallel) {
-      switch (this->roi->width) {
-        case 4:
-          this->roi->center = this->id == 0U ? 150 : 247;
-          break;
-        case 5:
-        case 6:
-          this->roi->center = this->id == 0U ? 159 : 239;
-          break;
-        case 7:
-        case 8:
-          this->roi->center = this->id == 0U ? 167 : 231;
-          break;
-      }
-    } else {
-      switch (this->roi->width) {
-        case 4:
-          this->roi->center = this->id == 0U ? 193 : 58;
-          break;
-        case 5:
-        case 6:
-          this->roi->center = this->id == 0U ? 194 : 59;
-          break;
-        case 7:
-        case 8:
-          this->roi->center = this->id == 0U ? 195 : 60;
-          break;
-      }
+void Zone::restore_calibration(const ZoneCalibration &calibration) {
+  threshold.idle = calibration.idle;
+  threshold.min = calibration.min;
+  threshold.max = calibration.max;
+  roi = calibration.roi;
+  ESP_LOGI(CALIBRATION, "Restored calibration for zone. zoneId: %d, idle: %d, min: %d, max: %d", id, threshold.idle,
+           threshold.min, threshold.max);
+}
+
+/**
+ * Takes a few live readings to check that a restored calibration still fits the scene.
+ * Only readings near the idle distance confirm it. Closer ones may be somebody walking through and are retried a bit
+ * later, but a floor that moved closer (a box, a moved mount) looks just the same, so they never count as a match.
+ */
+bool Zone::verify_calibration(TofSensor *distanceSensor, int number_attempts) {
+  int tolerance = max(threshold.idle / 10, 50);
+  int matches = 0;
+  int retries = 0;
+  for (int i = 0; i < number_attempts; i++) {
+    if (this->readDistance(distanceSensor) != VL53L1_ERROR_NONE) {
+      continue;
     }
+    int distance = this->getDistance();
+    if (abs(distance - threshold.idle) <= tolerance) {
+      matches++;
+      continue;
+    }
+    if (Detector::is_occupied(distance, threshold) && retries < MAX_VERIFICATION_RETRIES) {
+      ESP_LOGD(CALIBRATION, "Zone occupied while verifying calibration, retrying. zoneId: %d, distance: %d", id,
+               distance);
+      retries++;
+      i--;
+      delay(VERIFICATION_RETRY_DELAY_MS);
+      App.feed_wdt();
+      continue;
+    }
+    ESP_LOGD(CALIBRATION, "Reading does not match calibration. zoneId: %d, distance: %d, idle: %d", id, distance,
+             threshold.idle);
   }
-  ESP_LOGI(CALIBRATION, "Calibrated ROI for zone. zoneId: %d, width: %d, height: %d, center: %d", id, roi->width,
-           roi->height, roi->center);
+  return matches * 2 > number_attempts;
 }
 
-int Zone::getOptimizedValues(int *values, int sum, int size) {
-  int sum_squared = 0;
-  int variance = 0;
-  int sd = 0;
-  int avg = sum / size;
-
-  for (int i = 0; i < size; i++) {
-    sum_squared = sum_squared + (values[i] * values[i]);
-    App.feed_wdt();
-  }
-  variance = sum_squared / size - (avg * avg);
-  sd = sqrt(variance);
+int Zone::getOptimizedValues(double mean, double m2, int size) {
+  int avg = mean;
+  int sd = sqrt(m2 / size);
   ESP_LOGD(CALIBRATION, "Zone AVG: %d", avg);
   ESP_LOGD(CALIBRATION, "Zone SD: %d", sd);
   return avg - sd;
 }
 
 uint16_t Zone::getDistance() const { return this->last_distance; }
-uint16_t Zone::getMinDistance() const { return this->min_distance; }
+uint16_t Zone::getMinDistance() const { return this->filtered_distance; }
 }  // namespace roode
 }  // namespace esphome
\ No newline at end of file
@@ -6,25 +6,54 @@
 #include "esphome/core/optional.h"
 #include "../vl53l1x/vl53l1x.h"
 #include "orientation.h"
+#include "pipeline.h"
 
 using TofSensor = esphome::vl53l1x::VL53L1X;
 using esphome::vl53l1x::ROI;
 
 static const char *const TAG = "Zone";
 static const char *const CALIBRATION = "Zone calibration";
+/** Somebody walking through a zone while a restored calibration is verified is gone after about this many retries */
+static const int MAX_VERIFICATION_RETRIES = 10;
+static const uint32_t VERIFICATION_RETRY_DELAY_MS = 100;
 namespace esphome {
 namespace roode {
 struct Threshold {
   /** Automatically determined idling distance (average of several measurements) */
-  uint16_t idle;
-  uint16_t min;
+  uint16_t idle{};
+  uint16_t min{};
   optional<uint8_t> min_percentage{};
-  uint16_t max;
+  uint16_t max{};
   optional<uint8_t> max_percentage{};
   void set_min(uint16_t min) { this->min = min; }
   void set_min_percentage(uint8_t min) { this->min_percentage = min; }
   void set_max(uint16_t max) { this->max = max; }
   void set_max_percentage(uint8_t max) { this->max_percentage = max; }
+  /** The max threshold that applies to the given idle distance */
+  uint16_t max_for(uint16_t idle) const {
+    return max_percentage.has_value() ? (idle * max_percentage.value()) / 100 : max;
+  }
+};
+
+/**
+ * How many readings calibrating a zone takes: at least `min_samples`, then until the idle distance is known to within
+ * `tolerance` mm with 95% confidence, but no more than `max_samples`.
+ */
+struct CalibrationSampling {
+  uint16_t tolerance{10};
+  uint16_t min_samples{8};
+  uint16_t max_samples{60};
+  void set_tolerance(uint16_t val) { this->tolerance = val; }
+  void set_min_samples(uint16_t val) { this->min_samples = val; }
+  void set_max_samples(uint16_t val) { this->max_samples = val; }
+};
+
+/** The result of calibrating a zone. This is persisted so that calibration can be skipped on boot. */
+struct ZoneCalibration {
+  uint16_t idle;
+  uint16_t min;
+  uint16_t max;
+  ROI roi;
 };
 
 class Zone {
@@ -33,24 +62,26 @@ class Zone {
   void dump_config() const;
   VL53L1_Error readDistance(TofSensor *distanceSensor);
   void reset_roi(uint8_t default_center);
-  void calibrateThreshold(TofSensor *distanceSensor, int number_attempts);
-  void roi_calibration(uint16_t entry_threshold, uint16_t exit_threshold, Orientation orientation);
+  /** Returns the number of readings taken, 0 if none succeeded and the thresholds weren't changed */
+  uint16_t calibrateThreshold(TofSensor *distanceSensor, const CalibrationSampling &sampling);
+  ZoneCalibration get_calibration() const { return {threshold.idle, threshold.min, threshold.max, roi}; }
+  void restore_calibration(const ZoneCalibration &calibration);
+  bool verify_calibration(TofSensor *distanceSensor, int number_attempts);
   const uint8_t id;
   uint16_t getDistance() const;
   uint16_t getMinDistance() const;
-  ROI *roi = new ROI();
-  ROI *roi_override = new ROI();
-  Threshold *threshold = new Threshold();
-  void set_max_samples(uint8_t max) { max_samples = max; };
+  ROI roi{};
+  ROI roi_override{};
+  Threshold threshold{};
+  void set_max_samples(uint8_t max) { filter.set_size(max); };
 
  protected:
-  int getOptimizedValues(int *values, int sum, int size);
+  int getOptimizedValues(double mean, double m2, int size);
   VL53L1_Error last_sensor_status = VL53L1_ERROR_NONE;
   VL53L1_Error sensor_status = VL53L1_ERROR_NONE;
-  uint16_t last_distance;
-  uint16_t min_distance;
-  std::vector<uint16_t> samples;
-  uint8_t max_samples;
+  uint16_t last_distance{};
+  uint16_t filtered_distance{};
+  Filter filter{};
 };
 }  // namespace roode
 }  // namespace esphome
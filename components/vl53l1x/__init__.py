@@ -146,7 +146,9 @@ async def setup_hardware(vl53l1x: cg.Pvariable, config: Dict):
 
 async def setup_calibration(vl53l1x: cg.Pvariable, config: Dict):
     if config.get(CONF_RANGING_MODE, CONF_AUTO) != CONF_AUTO:
-        cg.add(vl53l1x.set_ranging_mode_override(config[CONF_RANGING_MODE]))
+        # Ranging modes are constexpr tables, so pass a pointer to the static instance
+        mode = RANGING_MODES[config[CONF_RANGING_MODE]]
+        cg.add(vl53l1x.set_ranging_mode_override(cg.RawExpression(f"&{mode}")))
     if CONF_XTALK in config:
         cg.add(vl53l1x.set_xtalk(config[CONF_XTALK]))
     if CONF_OFFSET in config:
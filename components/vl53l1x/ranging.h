@@ -5,24 +5,33 @@ namespace esphome {
 namespace vl53l1x {
 
 struct RangingMode {
-  explicit RangingMode(const char * name, uint16_t timing_budget, EDistanceMode mode = EDistanceMode::Long)
-      : name{name}, timing_budget{timing_budget}, mode{mode} {}
+  constexpr RangingMode(const char *name, uint16_t timing_budget, EDistanceMode mode = EDistanceMode::Long)
+      : name{name}, timing_budget{timing_budget}, delay_between_measurements{uint16_t(timing_budget + 5)}, mode{mode} {}
 
-  const char *name;
+  const char *const name;
   uint16_t const timing_budget;
-  uint16_t const delay_between_measurements = timing_budget + 5;
+  uint16_t const delay_between_measurements;
   EDistanceMode const mode;
+
+  constexpr bool operator==(const RangingMode &rhs) const {
+    return timing_budget == rhs.timing_budget && mode == rhs.mode;
+  }
+  constexpr bool operator!=(const RangingMode &rhs) const { return !(rhs == *this); }
 };
 
+/**
+ * The available ranging modes. These live in flash/rodata, reference them by address (i.e. `&Ranging::Short`).
+ */
 namespace Ranging {
-// NOLINTBEGIN(cert-err58-cpp)
-__attribute__((unused)) static const RangingMode *Shortest = new RangingMode("Shortest", 15, Short);
-__attribute__((unused)) static const RangingMode *Short = new RangingMode("Short", 20);
-__attribute__((unused)) static const RangingMode *Medium = new RangingMode("Medium", 33);
-__attribute__((unused)) static const RangingMode *Long = new RangingMode("Long", 50);
-__attribute__((unused)) static const RangingMode *Longer = new RangingMode("Longer", 100);
-__attribute__((unused)) static const RangingMode *Longest = new RangingMode("Longest", 200);
-// NOLINTEND(cert-err58-cpp)
+static constexpr RangingMode Shortest{"Shortest", 15, EDistanceMode::Short};
+static constexpr RangingMode Short{"Short", 20};
+static constexpr RangingMode Medium{"Medium", 33};
+static constexpr RangingMode Long{"Long", 50};
+static constexpr RangingMode Longer{"Longer", 100};
+static constexpr RangingMode Longest{"Longest", 200};
+
+/** All ranging modes, ordered by timing budget. Indexes are persisted, only append to this. */
+static constexpr const RangingMode *const All[] = {&Shortest, &Short, &Medium, &Long, &Longer, &Longest};
 }  // namespace Ranging
 
 }  // namespace vl53l1x
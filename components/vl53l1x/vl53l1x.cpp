@@ -22,12 +22,27 @@ void VL53L1X::dump_config() {
 void VL53L1X::setup() {
   ESP_LOGD(TAG, "Beginning setup");
 
-  // TODO use xshut_pin, if given, to change address
-  auto status = this->init();
-  if (status != VL53L1_ERROR_NONE) {
+  if (this->xshut_pin.has_value()) {
+    this->xshut_pin.value()->setup();
+    this->xshut_pin.value()->digital_write(true);
+  }
+  if (this->interrupt_pin.has_value()) {
+    this->interrupt_pin.value()->setup();
+  }
+  if (this->configure() != VL53L1_ERROR_NONE) {
     this->mark_failed();
     return;
   }
+
+  ESP_LOGI(TAG, "Setup complete");
+}
+
+/** Initializes the device and applies the user calibration */
+VL53L1_Error VL53L1X::configure() {
+  auto status = this->init();
+  if (status != VL53L1_ERROR_NONE) {
+    return status;
+  }
   ESP_LOGD(TAG, "Device initialized");
 
   if (this->offset.has_value()) {
@@ -35,8 +50,7 @@ void VL53L1X::setup() {
     status = this->sensor.SetOffsetInMm(this->offset.value());
     if (status != VL53L1_ERROR_NONE) {
       ESP_LOGE(TAG, "Could not set offset calibration, error code: %d", status);
-      this->mark_failed();
-      return;
+      return status;
     }
   }
 
@@ -45,12 +59,10 @@ void VL53L1X::setup() {
     status = this->sensor.SetXTalk(this->xtalk.value());
     if (status != VL53L1_ERROR_NONE) {
       ESP_LOGE(TAG, "Could not set crosstalk calibration, error code: %d", status);
-      this->mark_failed();
-      return;
+      return status;
     }
   }
-
-  ESP_LOGI(TAG, "Setup complete");
+  return status;
 }
 
 VL53L1_Error VL53L1X::init() {
@@ -99,7 +111,7 @@ VL53L1_Error VL53L1X::wait_for_boot() {
       ESP_LOGD(TAG, "Finished waiting for boot. Device state: %d", device_state);
       return VL53L1_ERROR_NONE;
     }
-    App.feed_wdt();
+    this->feed_wdt();
   }
 
   ESP_LOGW(TAG, "Timed out waiting for boot. state: %d", device_state);
@@ -150,7 +162,7 @@ void VL53L1X::set_ranging_mode(const RangingMode *mode) {
   ESP_LOGI(TAG, "Set ranging mode: %s", mode->name);
 }
 
-optional<uint16_t> VL53L1X::read_distance(ROI *roi, VL53L1_Error &status) {
+optional<uint16_t> VL53L1X::read_distance(const ROI &roi, VL53L1_Error &status) {
   if (this->is_failed()) {
     ESP_LOGW(TAG, "Cannot read distance while component is failed");
     return {};
@@ -158,15 +170,15 @@ optional<uint16_t> VL53L1X::read_distance(ROI *roi, VL53L1_Error &status) {
 
   ESP_LOGVV(TAG, "Beginning distance read");
 
-  if (last_roi == nullptr || *roi != *last_roi) {
-    ESP_LOGVV(TAG, "Setting new ROI: { width: %d, height: %d, center: %d }", roi->width, roi->height, roi->center);
+  if (!last_roi.has_value() || roi != last_roi.value()) {
+    ESP_LOGVV(TAG, "Setting new ROI: { width: %d, height: %d, center: %d }", roi.width, roi.height, roi.center);
 
-    status = this->sensor.SetROI(roi->width, roi->height);
+    status = this->sensor.SetROI(roi.width, roi.height);
     if (status != VL53L1_ERROR_NONE) {
       ESP_LOGE(TAG, "Could not set ROI width/height, error code: %d", status);
       return {};
     }
-    status = this->sensor.SetROICenter(roi->center);
+    status = this->sensor.SetROICenter(roi.center);
     if (status != VL53L1_ERROR_NONE) {
       ESP_LOGE(TAG, "Could not set ROI center, error code: %d", status);
       return {};
@@ -175,18 +187,29 @@ optional<uint16_t> VL53L1X::read_distance(ROI *roi, VL53L1_Error &status) {
   }
 
   status = this->sensor.StartRanging();
+  if (status != VL53L1_ERROR_NONE) {
+    // otherwise data never gets ready and this would block until the timeout
+    ESP_LOGE(TAG, "Could not start ranging, error code: %d", status);
+    return {};
+  }
 
   // Wait for the measurement to be ready
   // TODO use interrupt_pin, if given, to await data ready instead of polling
   uint8_t dataReady = false;
+  auto start = millis();
   while (!dataReady) {
     status = this->sensor.CheckForDataReady(&dataReady);
     if (status != VL53L1_ERROR_NONE) {
       ESP_LOGE(TAG, "Failed to check if data is ready, error code: %d", status);
       return {};
     }
+    if (!dataReady && (millis() - start) >= this->timeout) {
+      ESP_LOGE(TAG, "Timed out waiting for data");
+      status = VL53L1_ERROR_TIME_OUT;
+      return {};
+    }
     delay(1);
-    App.feed_wdt();
+    this->feed_wdt();
   }
 
   // Get the results
@@ -213,5 +236,135 @@ optional<uint16_t> VL53L1X::read_distance(ROI *roi, VL53L1_Error &status) {
   return {distance};
 }
 
+/**
+ * Ranges continuously with the whole field of view, raising the interrupt only for a distance below `below` mm.
+ * Meant for idling: the sensor watches the doorway on its own, while nobody needs to read it.
+ */
+VL53L1_Error VL53L1X::start_presence_detection(uint16_t below, uint32_t inter_measurement) {
+  ESP_LOGD(TAG, "Starting presence detection below %umm every %ums", below, inter_measurement);
+  this->last_roi.reset();
+  auto status = this->sensor.SetROI(16, 16);
+  if (status == VL53L1_ERROR_NONE) {
+    status = this->sensor.SetROICenter(199);
+  }
+  if (status == VL53L1_ERROR_NONE) {
+    // the inter-measurement period can't be shorter than the timing budget
+    uint32_t budget = this->ranging_mode != nullptr ? this->ranging_mode->delay_between_measurements : 0;
+    status = this->sensor.SetInterMeasurementInMs(std::max(inter_measurement, budget));
+  }
+  if (status == VL53L1_ERROR_NONE) {
+    status = this->sensor.SetDistanceThreshold(below, 0, Below, 0);
+  }
+  if (status == VL53L1_ERROR_NONE) {
+    status = this->sensor.StartRanging();
+  }
+  if (status != VL53L1_ERROR_NONE) {
+    ESP_LOGE(TAG, "Could not start presence detection, error code: %d", status);
+  }
+  return status;
+}
+
+/** Whether presence detection saw something, from the interrupt pin if there is one or over I2C otherwise */
+bool VL53L1X::check_presence(VL53L1_Error &status) {
+  status = VL53L1_ERROR_NONE;
+  if (this->interrupt_pin.has_value()) {
+    // GPIO1 is active high by default, `inverted` in the pin config handles boards pulling it the other way
+    return this->interrupt_pin.value()->digital_read();
+  }
+  uint8_t detected = false;
+  status = this->sensor.CheckForDataReady(&detected);
+  if (status != VL53L1_ERROR_NONE) {
+    ESP_LOGE(TAG, "Failed to check for presence, error code: %d", status);
+    return false;
+  }
+  return detected;
+}
+
+/**
+ * Stops presence detection and goes back to reading single zones.
+ * The ULD has no call to drop the threshold again, so it is opened up to every distance, including no target at all,
+ * which raises the interrupt for every measurement like it did before.
+ */
+VL53L1_Error VL53L1X::stop_presence_detection() {
+  ESP_LOGD(TAG, "Stopping presence detection");
+  auto status = this->sensor.StopRanging();
+  if (status == VL53L1_ERROR_NONE) {
+    status = this->sensor.ClearInterrupt();
+  }
+  if (status == VL53L1_ERROR_NONE) {
+    status = this->sensor.SetDistanceThreshold(UINT16_MAX, 0, Below, 1);
+  }
+  if (status == VL53L1_ERROR_NONE && this->ranging_mode != nullptr) {
+    status = this->sensor.SetInterMeasurementInMs(this->ranging_mode->delay_between_measurements);
+  }
+  if (status != VL53L1_ERROR_NONE) {
+    ESP_LOGE(TAG, "Could not stop presence detection, error code: %d", status);
+  }
+  return status;
+}
+
+/**
+ * Recovery step for a sensor that stopped answering properly: clear a pending interrupt and stop ranging,
+ * so the next read starts a fresh measurement.
+ */
+VL53L1_Error VL53L1X::restart_ranging() {
+  ESP_LOGI(TAG, "Restarting ranging");
+  this->last_roi.reset();
+  auto status = this->sensor.ClearInterrupt();
+  if (status != VL53L1_ERROR_NONE) {
+    ESP_LOGW(TAG, "Could not clear interrupt, error code: %d", status);
+    return status;
+  }
+  status = this->sensor.StopRanging();
+  if (status != VL53L1_ERROR_NONE) {
+    ESP_LOGW(TAG, "Could not stop ranging, error code: %d", status);
+  }
+  return status;
+}
+
+/** Recovery step which initializes the sensor again, restoring the calibration and ranging mode */
+VL53L1_Error VL53L1X::reinit() {
+  ESP_LOGI(TAG, "Re-initializing");
+  this->last_roi.reset();
+  auto status = this->configure();
+  if (status != VL53L1_ERROR_NONE) {
+    return status;
+  }
+  if (this->ranging_mode != nullptr) {
+    this->set_ranging_mode(this->ranging_mode);
+  }
+  return status;
+}
+
+/** Waiting for the sensor can take longer than the watchdog allows */
+void VL53L1X::feed_wdt() {
+  if (!this->driven_by_task) {
+    App.feed_wdt();
+    return;
+  }
+#ifdef USE_ESP32
+  esp_task_wdt_reset();
+#endif
+}
+
+/**
+ * Last resort recovery step, which cuts the power of the sensor through the xshut pin.
+ * Without an xshut pin this is the same as re-initializing.
+ * The sensor comes back at the default address, from where init() moves it to the configured one again.
+ */
+VL53L1_Error VL53L1X::power_cycle() {
+  if (!this->xshut_pin.has_value()) {
+    ESP_LOGD(TAG, "No xshut pin to power cycle with");
+    return this->reinit();
+  }
+  ESP_LOGI(TAG, "Power cycling");
+  this->xshut_pin.value()->digital_write(false);
+  delay(10);
+  this->xshut_pin.value()->digital_write(true);
+  // a fresh driver talks to the default address, like the sensor after booting
+  this->sensor = VL53L1X_ULD();
+  return this->reinit();
+}
+
 }  // namespace vl53l1x
 }  // namespace esphome
@@ -1,5 +1,6 @@
 #pragma once
 #include <math.h>
+#include <algorithm>
 
 #include "VL53L1X_ULD.h"
 #include "esphome/components/i2c/i2c.h"
@@ -7,6 +8,9 @@
 #include "esphome/core/component.h"
 #include "esphome/core/gpio.h"
 #include "esphome/core/log.h"
+#ifdef USE_ESP32
+#include <esp_task_wdt.h>
+#endif
 #include "ranging.h"
 #include "roi.h"
 
@@ -25,29 +29,45 @@ class VL53L1X : public i2c::I2CDevice, public Component {
   /** This connects directly to a sensor */
   float get_setup_priority() const override { return setup_priority::DATA; };
 
-  optional<uint16_t> read_distance(ROI *roi, VL53L1_Error &error);
+  optional<uint16_t> read_distance(const ROI &roi, VL53L1_Error &error);
+  VL53L1_Error start_presence_detection(uint16_t below, uint32_t inter_measurement);
+  bool check_presence(VL53L1_Error &status);
+  VL53L1_Error stop_presence_detection();
+  VL53L1_Error restart_ranging();
+  VL53L1_Error reinit();
+  VL53L1_Error power_cycle();
   void set_ranging_mode(const RangingMode *mode);
+  const RangingMode *get_ranging_mode() const { return this->ranging_mode; }
 
   void set_xshut_pin(GPIOPin *pin) { this->xshut_pin = pin; }
   void set_interrupt_pin(InternalGPIOPin *pin) { this->interrupt_pin = pin; }
+  InternalGPIOPin *get_interrupt_pin() const { return this->interrupt_pin.value_or(nullptr); }
   optional<const RangingMode *> get_ranging_mode_override() { return this->ranging_mode_override; }
   void set_ranging_mode_override(const RangingMode *mode) { this->ranging_mode_override = {mode}; }
   void set_offset(int16_t val) { this->offset = val; }
   void set_xtalk(uint16_t val) { this->xtalk = val; }
   void set_timeout(uint16_t val) { this->timeout = val; }
+  /**
+   * Whether the sensor is driven from a task of its own instead of the main loop. Waiting for the sensor then feeds
+   * that task's watchdog, App.feed_wdt() is only meant for the main loop.
+   */
+  void set_driven_by_task(bool val) { this->driven_by_task = val; }
 
  protected:
   VL53L1X_ULD sensor;
   optional<GPIOPin *> xshut_pin{};
   optional<InternalGPIOPin *> interrupt_pin{};
-  const RangingMode * ranging_mode{};
+  const RangingMode *ranging_mode{};
   /** Mode from user config, which can be get/set independently of current mode */
   optional<const RangingMode *> ranging_mode_override{};
   optional<int16_t> offset{};
   optional<uint16_t> xtalk{};
   uint16_t timeout{};
-  ROI *last_roi{};
+  optional<ROI> last_roi{};
+  bool driven_by_task{false};
 
+  VL53L1_Error configure();
+  void feed_wdt();
   VL53L1_Error init();
   VL53L1_Error wait_for_boot();
   VL53L1_Error get_device_state(uint8_t *device_state);
@@ -0,0 +1,474 @@
+/**
+ * Trains & evaluates the crossing classifier (components/roode/classifier.h) on recorded raw streams.
+ *
+ * A trace is a raw stream (see "Raw stream" in the README), from a device or the simulator's --raw-stream, and a label
+ * file with a `run,timestamp_us,direction` line per person, when they passed below the sensor: 1 for an entry, -1 for an
+ * exit, 0 for somebody turning around. A run starts wherever the stream's timestamps start over, a recording from a
+ * device is run 0. The simulator writes matching labels with --labels.
+ *
+ * The samples are run through the same filter, detector & feature extraction as on the device, and every episode is
+ * labelled with the crossings during it. `train` fits the model on most runs and reports how it does on the rest,
+ * `evaluate` checks the built-in model. Both compare it to the path tracker on the same episodes.
+ */
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "roode/pipeline.h"
+
+namespace esphome {
+int host_log_level = ESPHOME_LOG_LEVEL_WARN;  // NOLINT
+}  // namespace esphome
+
+using esphome::roode::classify;
+using esphome::roode::CrossingFeatures;
+using esphome::roode::CrossingModel;
+using esphome::roode::CrossingRecorder;
+using esphome::roode::PathTracker;
+using esphome::roode::ThresholdDetector;
+using esphome::roode::TrackingEvent;
+
+namespace {
+
+const uint8_t FEATURES = CrossingFeatures::COUNT;
+const char *const FEATURE_NAMES[FEATURES] = {"dwell_left", "dwell_right", "on_delta", "off_delta",
+                                             "overlap",    "depth",       "speed",    "consistency", "path"};
+/** Labels this far before or after an episode still count towards it */
+const uint32_t LABEL_SLACK_MS = 500;
+
+struct Options {
+  bool train = false;
+  const char *trace = nullptr;
+  const char *labels = nullptr;
+  uint8_t sampling = 2;
+  /** Maximum detection threshold in percent of the idle distance, as configured on the device */
+  uint8_t max_threshold = 85;
+  /** Every n-th run is held out for testing */
+  uint32_t test_every = 4;
+  uint32_t epochs = 3000;
+  float learning_rate = 0.5f;
+  float l2 = 0.001f;
+};
+
+struct Sample {
+  uint8_t zone;
+  bool valid;
+  uint16_t distance;
+  uint64_t time_us;
+};
+
+struct Label {
+  uint64_t time_us;
+  int direction;
+};
+
+struct Run {
+  std::vector<Sample> samples;
+  std::vector<Label> labels;
+};
+
+struct Episode {
+  CrossingFeatures features;
+  uint32_t start_ms;
+  uint32_t end_ms;
+  /** What the path tracker made of it */
+  int path_direction;
+  /** Sum of the crossings labelled during the episode */
+  int label;
+  uint32_t run;
+};
+
+struct Threshold {
+  uint16_t min;
+  uint16_t max;
+};
+
+uint16_t get_uint16(const uint8_t *data) { return data[0] | (data[1] << 8); }
+uint32_t get_uint32(const uint8_t *data) { return get_uint16(data) | (uint32_t(get_uint16(data + 2)) << 16); }
+
+/** Splits the raw stream into runs, wherever the timestamps jump back other than by wrapping around */
+bool read_trace(const char *path, std::vector<Run> &runs) {
+  FILE *file = fopen(path, "rb");
+  if (file == nullptr) {
+    perror(path);
+    return false;
+  }
+  uint8_t header[8];
+  uint64_t offset = 0;
+  uint32_t previous = 0;
+  bool first = true;
+  while (fread(header, sizeof(header), 1, file) == 1) {
+    if (header[0] != 'R' || header[1] != 1) {
+      fprintf(stderr, "%s: not a raw stream packet\n", path);
+      fclose(file);
+      return false;
+    }
+    uint16_t count = get_uint16(header + 2);
+    uint32_t timestamp = get_uint32(header + 4);
+    if (first || (timestamp < previous && previous - timestamp < 0x80000000UL)) {
+      runs.emplace_back();
+      offset = 0;
+    } else if (timestamp < previous) {
+      offset += 0x100000000ULL;
+    }
+    first = false;
+    uint64_t time_us = offset + timestamp;
+    for (uint16_t i = 0; i < count; i++) {
+      uint8_t data[5];
+      if (fread(data, sizeof(data), 1, file) != 1) {
+        fprintf(stderr, "%s: truncated packet\n", path);
+        break;
+      }
+      time_us += uint64_t(get_uint16(data + 3)) * 100;
+      // the 7 bit status is signed, 0 is VL53L1_ERROR_NONE
+      runs.back().samples.push_back({uint8_t(data[0] >> 7), (data[0] & 0x7F) == 0, get_uint16(data + 1), time_us});
+    }
+    previous = uint32_t(time_us);
+  }
+  fclose(file);
+  return true;
+}
+
+bool read_labels(const char *path, std::vector<Run> &runs) {
+  FILE *file = fopen(path, "r");
+  if (file == nullptr) {
+    perror(path);
+    return false;
+  }
+  unsigned run;
+  unsigned long long time_us;
+  int direction;
+  while (fscanf(file, "%u,%llu,%d", &run, &time_us, &direction) == 3) {
+    if (run >= runs.size()) {
+      fprintf(stderr, "%s: run %u is not in the trace\n", path, run);
+      continue;
+    }
+    // labels carry the device's 32 bit timestamp, the samples are unwrapped
+    auto &samples = runs[run].samples;
+    uint64_t base = samples.empty() ? 0 : samples.front().time_us & ~0xFFFFFFFFULL;
+    uint64_t time = base + time_us;
+    if (!samples.empty() && time < samples.front().time_us) {
+      time += 0x100000000ULL;
+    }
+    runs[run].labels.push_back({time, direction});
+  }
+  fclose(file);
+  return true;
+}
+
+/** Replays a run like Roode::path_tracking does, after calibrating the thresholds on the first readings */
+std::vector<Episode> replay(const Options &options, const Run &run, uint32_t index, uint32_t &missed) {
+  std::vector<uint16_t> idle[2];
+  for (const auto &sample : run.samples) {
+    if (sample.valid && idle[sample.zone].size() < 16) {
+      idle[sample.zone].push_back(sample.distance);
+    }
+  }
+  Threshold thresholds[2];
+  for (uint8_t zone = 0; zone < 2; zone++) {
+    if (idle[zone].empty()) {
+      return {};
+    }
+    std::nth_element(idle[zone].begin(), idle[zone].begin() + idle[zone].size() / 2, idle[zone].end());
+    thresholds[zone] = {0, uint16_t(idle[zone][idle[zone].size() / 2] * options.max_threshold / 100)};
+  }
+
+  esphome::roode::Filter filters[2];
+  for (auto &filter : filters) {
+    filter.set_size(options.sampling);
+  }
+  CrossingRecorder recorder;
+  PathTracker<false> path_tracker;
+  std::vector<Episode> episodes;
+  uint32_t start_ms = 0;
+  for (const auto &sample : run.samples) {
+    if (!sample.valid) {
+      continue;
+    }
+    uint16_t distance = filters[sample.zone].update(sample.distance);
+    bool left = sample.zone == 0;
+    bool occupied = ThresholdDetector::is_occupied(distance, thresholds[sample.zone]);
+    auto now_ms = uint32_t(sample.time_us / 1000);
+    int path_direction = 0;
+    path_tracker.update(left, occupied, distance, now_ms, [&](TrackingEvent event, int direction, uint8_t) {
+      if (event == TrackingEvent::Crossing) {
+        path_direction = direction;
+      }
+    });
+    bool was_active = recorder.is_active();
+    if (recorder.add(left, occupied, distance, now_ms)) {
+      episodes.push_back({recorder.features(), start_ms, now_ms, path_direction, 0, index});
+    } else if (!was_active && recorder.is_active()) {
+      start_ms = now_ms;
+    }
+  }
+
+  for (const auto &label : run.labels) {
+    auto time_ms = uint32_t(label.time_us / 1000);
+    // the episode the crossing happened in, or else the closest one
+    Episode *match = nullptr;
+    uint32_t closest = LABEL_SLACK_MS + 1;
+    for (auto &episode : episodes) {
+      uint32_t gap = time_ms < episode.start_ms ? episode.start_ms - time_ms
+                                                : (time_ms > episode.end_ms ? time_ms - episode.end_ms : 0);
+      if (gap < closest) {
+        closest = gap;
+        match = &episode;
+      }
+    }
+    if (match != nullptr) {
+      match->label += label.direction;
+    } else if (label.direction != 0) {
+      missed++;
+    }
+  }
+  return episodes;
+}
+
+int sign(int value) { return (value > 0) - (value < 0); }
+
+/** The features as the model sees them, after shifting */
+std::vector<float> shifted(const CrossingModel &model, const CrossingFeatures &features) {
+  std::vector<float> values(FEATURES);
+  for (uint8_t i = 0; i < FEATURES; i++) {
+    int32_t value = features.values[i] >> model.shifts[i];
+    values[i] = std::max<int32_t>(-CrossingModel::MAX_FEATURE, std::min<int32_t>(CrossingModel::MAX_FEATURE, value));
+  }
+  return values;
+}
+
+/** Multinomial logistic regression over ignore (fixed at 0), entry & exit, quantized to the model's fixed point */
+CrossingModel train(const Options &options, const std::vector<const Episode *> &episodes) {
+  CrossingModel model{};
+  for (uint8_t i = 0; i < FEATURES; i++) {
+    int32_t max = 0;
+    for (const auto *episode : episodes) {
+      max = std::max<int32_t>(max, std::abs(episode->features.values[i]));
+    }
+    while ((max >> model.shifts[i]) > CrossingModel::MAX_FEATURE) {
+      model.shifts[i]++;
+    }
+  }
+
+  // standardized for gradient descent, folded back into the weights afterwards
+  std::vector<std::vector<float>> inputs;
+  for (const auto *episode : episodes) {
+    inputs.push_back(shifted(model, episode->features));
+  }
+  std::vector<float> mean(FEATURES, 0), scale(FEATURES, 0);
+  for (const auto &input : inputs) {
+    for (uint8_t i = 0; i < FEATURES; i++) {
+      mean[i] += input[i] / inputs.size();
+    }
+  }
+  for (const auto &input : inputs) {
+    for (uint8_t i = 0; i < FEATURES; i++) {
+      scale[i] += (input[i] - mean[i]) * (input[i] - mean[i]) / inputs.size();
+    }
+  }
+  for (auto &value : scale) {
+    value = value > 0 ? std::sqrt(value) : 1;
+  }
+  for (auto &input : inputs) {
+    for (uint8_t i = 0; i < FEATURES; i++) {
+      input[i] = (input[i] - mean[i]) / scale[i];
+    }
+  }
+
+  // weights[0] for entries, weights[1] for exits, the bias last
+  std::vector<float> weights[2] = {std::vector<float>(FEATURES + 1, 0), std::vector<float>(FEATURES + 1, 0)};
+  for (uint32_t epoch = 0; epoch < options.epochs; epoch++) {
+    std::vector<float> gradients[2] = {std::vector<float>(FEATURES + 1, 0), std::vector<float>(FEATURES + 1, 0)};
+    for (size_t n = 0; n < inputs.size(); n++) {
+      float scores[2];
+      for (uint8_t c = 0; c < 2; c++) {
+        scores[c] = weights[c][FEATURES];
+        for (uint8_t i = 0; i < FEATURES; i++) {
+          scores[c] += weights[c][i] * inputs[n][i];
+        }
+      }
+      float top = std::max({scores[0], scores[1], 0.0f});
+      float sum = std::exp(-top) + std::exp(scores[0] - top) + std::exp(scores[1] - top);
+      int target = sign(episodes[n]->label);
+      for (uint8_t c = 0; c < 2; c++) {
+        float error = std::exp(scores[c] - top) / sum - (target == (c == 0 ? 1 : -1) ? 1.0f : 0.0f);
+        for (uint8_t i = 0; i < FEATURES; i++) {
+          gradients[c][i] += error * inputs[n][i] / inputs.size();
+        }
+        gradients[c][FEATURES] += error / inputs.size();
+      }
+    }
+    for (uint8_t c = 0; c < 2; c++) {
+      for (uint8_t i = 0; i <= FEATURES; i++) {
+        float decay = i < FEATURES ? options.l2 * weights[c][i] : 0;
+        weights[c][i] -= options.learning_rate * (gradients[c][i] + decay);
+      }
+    }
+  }
+
+  bool clipped = false;
+  auto quantize = [&clipped](float value) {
+    float scaled = std::round(value * CrossingModel::SCORE_ONE);
+    clipped |= std::abs(scaled) > INT16_MAX;
+    return int16_t(std::max<float>(-INT16_MAX, std::min<float>(INT16_MAX, scaled)));
+  };
+  for (uint8_t c = 0; c < 2; c++) {
+    auto &target = c == 0 ? model.entry : model.exit;
+    float bias = weights[c][FEATURES];
+    for (uint8_t i = 0; i < FEATURES; i++) {
+      float weight = weights[c][i] / scale[i];
+      target[i] = quantize(weight);
+      bias -= weight * mean[i];
+    }
+    (c == 0 ? model.entry_bias : model.exit_bias) = std::lround(bias * CrossingModel::SCORE_ONE);
+  }
+  if (clipped) {
+    fprintf(stderr, "Some weights were clipped to fit 16 bits, the model may be less accurate than trained\n");
+  }
+  return model;
+}
+
+void report(const char *name, const CrossingModel &model, const std::vector<const Episode *> &episodes,
+            uint32_t runs, uint32_t missed) {
+  uint32_t correct = 0, path_correct = 0;
+  // rows are the labels, columns the classification, both as exit, ignore, entry
+  uint32_t confusion[3][3] = {};
+  uint32_t path_confusion[3][3] = {};
+  std::map<uint32_t, int> labelled, counted, path_counted;
+  for (const auto *episode : episodes) {
+    int target = sign(episode->label);
+    int direction = classify(model, episode->features).direction;
+    correct += direction == target;
+    path_correct += episode->path_direction == target;
+    confusion[target + 1][direction + 1]++;
+    path_confusion[target + 1][episode->path_direction + 1]++;
+    labelled[episode->run] += episode->label;
+    counted[episode->run] += direction;
+    path_counted[episode->run] += episode->path_direction;
+  }
+  uint32_t exact = 0, path_exact = 0;
+  for (const auto &run : labelled) {
+    exact += counted[run.first] == run.second;
+    path_exact += path_counted[run.first] == run.second;
+  }
+  printf("%s: %u runs, %zu episodes, %u crossings without an episode\n", name, runs, episodes.size(), missed);
+  printf("  episodes right: classifier %.3f, path tracker %.3f\n", float(correct) / std::max<size_t>(1, episodes.size()),
+         float(path_correct) / std::max<size_t>(1, episodes.size()));
+  printf("  runs counted exactly: classifier %.3f, path tracker %.3f\n", float(exact) / std::max<size_t>(1, runs),
+         float(path_exact) / std::max<size_t>(1, runs));
+  printf("  label \\ classified   classifier: exit ignore entry   path tracker: exit ignore entry\n");
+  const char *const CLASSES[] = {"exit", "ignore", "entry"};
+  for (uint8_t row = 0; row < 3; row++) {
+    printf("  %-20s %16u %6u %5u %18u %6u %5u\n", CLASSES[row], confusion[row][0], confusion[row][1],
+           confusion[row][2], path_confusion[row][0], path_confusion[row][1], path_confusion[row][2]);
+  }
+}
+
+void print_model(const CrossingModel &model) {
+  auto list = [](const auto &values) {
+    std::string result;
+    for (auto value : values) {
+      result += (result.empty() ? "" : ", ") + std::to_string(value);
+    }
+    return result;
+  };
+  printf("\nFeatures: ");
+  for (uint8_t i = 0; i < FEATURES; i++) {
+    printf("%s%s", i == 0 ? "" : ", ", FEATURE_NAMES[i]);
+  }
+  printf("\n\nroode:\n  tracking: classifier\n  classifier_model:\n");
+  printf("    shifts: [%s]\n", list(model.shifts).c_str());
+  printf("    entry: [%s]\n", list(model.entry).c_str());
+  printf("    exit: [%s]\n", list(model.exit).c_str());
+  printf("    bias: [%d, %d]\n", model.entry_bias, model.exit_bias);
+  printf("\n#define ROODE_CROSSING_MODEL {{%s}, {%s}, {%s}, %d, %d}\n", list(model.shifts).c_str(),
+         list(model.entry).c_str(), list(model.exit).c_str(), model.entry_bias, model.exit_bias);
+}
+
+bool parse_options(int argc, char **argv, Options &options) {
+  if (argc < 4 || (strcmp(argv[1], "train") != 0 && strcmp(argv[1], "evaluate") != 0)) {
+    return false;
+  }
+  options.train = strcmp(argv[1], "train") == 0;
+  options.trace = argv[2];
+  options.labels = argv[3];
+  for (int i = 4; i + 1 < argc; i += 2) {
+    std::string name = argv[i];
+    const char *value = argv[i + 1];
+    if (name == "--sampling") {
+      options.sampling = atoi(value);
+    } else if (name == "--max-threshold") {
+      options.max_threshold = atoi(value);
+    } else if (name == "--test-every") {
+      options.test_every = std::max(2, atoi(value));
+    } else if (name == "--epochs") {
+      options.epochs = atoi(value);
+    } else if (name == "--l2") {
+      options.l2 = atof(value);
+    } else {
+      return false;
+    }
+  }
+  return true;
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  Options options;
+  if (!parse_options(argc, argv, options)) {
+    fprintf(stderr,
+            "Usage: %s train|evaluate TRACE LABELS [options]\n"
+            "  train                    fit a model on the runs, holding out some for testing, and print it\n"
+            "  evaluate                 check the built-in model on all runs\n"
+            "  --sampling N             sampling size configured on the device (2)\n"
+            "  --max-threshold P        maximum detection threshold configured on the device, in percent (85)\n"
+            "  --test-every N           hold out every N-th run for testing (4)\n"
+            "  --epochs N               gradient descent iterations (3000)\n"
+            "  --l2 X                   weight decay (0.001)\n",
+            argv[0]);
+    return 1;
+  }
+
+  std::vector<Run> runs;
+  if (!read_trace(options.trace, runs) || !read_labels(options.labels, runs)) {
+    return 1;
+  }
+  std::vector<Episode> episodes;
+  uint32_t missed[2] = {0, 0};
+  for (uint32_t index = 0; index < runs.size(); index++) {
+    bool test = !options.train || index % options.test_every == options.test_every - 1;
+    auto run_episodes = replay(options, runs[index], index, missed[test]);
+    episodes.insert(episodes.end(), run_episodes.begin(), run_episodes.end());
+  }
+  std::vector<const Episode *> training, testing;
+  uint32_t test_runs = 0;
+  for (uint32_t index = 0; index < runs.size(); index++) {
+    test_runs += !options.train || index % options.test_every == options.test_every - 1;
+  }
+  for (const auto &episode : episodes) {
+    bool test = !options.train || episode.run % options.test_every == options.test_every - 1;
+    (test ? testing : training).push_back(&episode);
+  }
+
+  if (!options.train) {
+    static constexpr CrossingModel MODEL = ROODE_CROSSING_MODEL;
+    report("All runs", MODEL, testing, test_runs, missed[1]);
+    return 0;
+  }
+  if (training.empty()) {
+    fprintf(stderr, "No episodes to train on\n");
+    return 1;
+  }
+  auto model = train(options, training);
+  report("Training", model, training, runs.size() - test_runs, missed[0]);
+  report("Testing", model, testing, test_runs, missed[1]);
+  print_model(model);
+  return 0;
+}
@@ -0,0 +1,83 @@
+#pragma once
+#include <cstdint>
+#include <functional>
+
+/**
+ * Host stand-in for the VL53L1X Ultra Lite Driver.
+ * Ranging results come from a scene callback instead of the sensor. Every call makes the same register accesses as
+ * the real driver over the mock I2C bus, which accounts for them, advances the simulated clock and injects faults.
+ * Only the parts of the driver used by the vl53l1x component are provided.
+ */
+
+typedef int8_t VL53L1_Error;
+#define VL53L1_ERROR_NONE ((VL53L1_Error) 0)
+#define VL53L1_ERROR_CALIBRATION_WARNING ((VL53L1_Error) -1)
+#define VL53L1_ERROR_MIN_CLIPPED ((VL53L1_Error) -2)
+#define VL53L1_ERROR_UNDEFINED ((VL53L1_Error) -3)
+#define VL53L1_ERROR_INVALID_PARAMS ((VL53L1_Error) -4)
+#define VL53L1_ERROR_NOT_SUPPORTED ((VL53L1_Error) -5)
+#define VL53L1_ERROR_RANGE_ERROR ((VL53L1_Error) -6)
+#define VL53L1_ERROR_TIME_OUT ((VL53L1_Error) -7)
+#define VL53L1_ERROR_MODE_NOT_SUPPORTED ((VL53L1_Error) -8)
+#define VL53L1_ERROR_BUFFER_TOO_SMALL ((VL53L1_Error) -9)
+#define VL53L1_ERROR_COMMS_BUFFER_TOO_SMALL ((VL53L1_Error) -10)
+#define VL53L1_ERROR_GPIO_NOT_EXISTING ((VL53L1_Error) -11)
+#define VL53L1_ERROR_GPIO_FUNCTIONALITY_NOT_SUPPORTED ((VL53L1_Error) -12)
+#define VL53L1_ERROR_CONTROL_INTERFACE ((VL53L1_Error) -13)
+
+enum EDistanceMode { Short = 1, Long = 2 };
+/** When a measurement raises the interrupt, relative to the distance threshold */
+enum EWindowMode { Below = 0, Above = 1, Out = 2, In = 3 };
+
+/** What the sensor is configured to measure when a ranging result is requested from the scene. */
+struct RangingContext {
+  uint16_t roi_width;
+  uint16_t roi_height;
+  uint8_t roi_center;
+  uint16_t timing_budget;
+  EDistanceMode distance_mode;
+  /** Simulated time the measurement finished at */
+  uint64_t time_us;
+};
+
+class VL53L1X_ULD {
+ public:
+  /** Produces the distance in mm the sensor would measure */
+  static std::function<uint16_t(const RangingContext &)> scene;  // NOLINT
+
+  uint8_t GetI2CAddress() { return this->address_; }
+  VL53L1_Error SetI2CAddress(uint8_t address);
+  VL53L1_Error Init();
+  VL53L1_Error GetBootState(uint8_t *state);
+  VL53L1_Error SetOffsetInMm(int16_t offset);
+  VL53L1_Error SetXTalk(uint16_t xtalk);
+  VL53L1_Error SetDistanceMode(EDistanceMode mode);
+  VL53L1_Error SetTimingBudgetInMs(uint16_t timing_budget);
+  VL53L1_Error SetInterMeasurementInMs(uint32_t inter_measurement);
+  VL53L1_Error SetROI(uint16_t width, uint16_t height);
+  VL53L1_Error SetROICenter(uint8_t center);
+  VL53L1_Error StartRanging();
+  VL53L1_Error StopRanging();
+  VL53L1_Error CheckForDataReady(uint8_t *ready);
+  VL53L1_Error GetDistanceInMm(uint16_t *distance);
+  VL53L1_Error ClearInterrupt();
+  VL53L1_Error SetDistanceThreshold(uint16_t low, uint16_t high, EWindowMode window, uint8_t interrupt_on_no_target);
+
+ protected:
+  /** Like the driver, a failed access doesn't stop the ones following it, the first error is returned */
+  VL53L1_Error write_(uint16_t reg, uint8_t size, VL53L1_Error status = VL53L1_ERROR_NONE);
+  VL53L1_Error read_(uint16_t reg, uint8_t size, uint32_t &value, VL53L1_Error status = VL53L1_ERROR_NONE);
+
+  uint8_t address_{0x52};
+  RangingContext context_{16, 16, 199, 100, Long, 0};
+  uint64_t ranging_started_us_{0};
+  uint32_t inter_measurement_ms_{100};
+  /** Threshold the measurements are checked against, unless every measurement raises the interrupt */
+  bool threshold_enabled_{false};
+  uint16_t threshold_low_{0};
+  uint16_t threshold_high_{0};
+  EWindowMode threshold_window_{Below};
+  /** Measurements since ranging started that were checked against the threshold */
+  uint32_t measurements_checked_{0};
+  bool threshold_reached_{false};
+};
@@ -0,0 +1,33 @@
+#pragma once
+#include "esphome/core/component.h"
+
+namespace esphome {
+namespace number {
+class Number;
+class NumberCall {
+ public:
+  explicit NumberCall(Number *parent) : parent_(parent) {}
+  NumberCall &set_value(float value) {
+    this->value_ = value;
+    return *this;
+  }
+  void perform();
+
+ protected:
+  Number *parent_;
+  float value_{0.0f};
+};
+class Number {
+ public:
+  virtual ~Number() = default;
+  NumberCall make_call() { return NumberCall(this); }
+  void publish_state(float state) { this->state = state; }
+  float state{0.0f};
+
+ protected:
+  friend class NumberCall;
+  virtual void control(float value) { this->publish_state(value); }
+};
+inline void NumberCall::perform() { this->parent_->control(this->value_); }
+}  // namespace number
+}  // namespace esphome
@@ -0,0 +1,19 @@
+#pragma once
+#include "esphome/core/component.h"
+
+namespace esphome {
+namespace sensor {
+class Sensor {
+ public:
+  void publish_state(float state) {
+    this->state = state;
+    this->has_state_ = true;
+  }
+  bool has_state() const { return this->has_state_; }
+  float state{0.0f};
+
+ protected:
+  bool has_state_{false};
+};
+}  // namespace sensor
+}  // namespace esphome
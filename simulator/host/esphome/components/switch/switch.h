@@ -0,0 +1,18 @@
+#pragma once
+#include "esphome/core/component.h"
+
+namespace esphome {
+namespace switch_ {
+class Switch {
+ public:
+  virtual ~Switch() = default;
+  void turn_on() { this->write_state(true); }
+  void turn_off() { this->write_state(false); }
+  void publish_state(bool state) { this->state = state; }
+  bool state{false};
+
+ protected:
+  virtual void write_state(bool state) = 0;
+};
+}  // namespace switch_
+}  // namespace esphome
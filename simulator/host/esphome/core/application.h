@@ -0,0 +1,17 @@
+#pragma once
+#include <string>
+#include <vector>
+#include "esphome/core/component.h"
+#include "esphome/components/binary_sensor/binary_sensor.h"
+#include "esphome/components/number/number.h"
+#include "esphome/components/sensor/sensor.h"
+#include "esphome/components/text_sensor/text_sensor.h"
+
+namespace esphome {
+class Application {
+ public:
+  void feed_wdt() {}
+  std::string get_compilation_time() const { return "host"; }
+};
+extern Application App;  // NOLINT
+}  // namespace esphome
@@ -0,0 +1,9 @@
+#pragma once
+// Generated by the codegen on device builds. The host build ships every entity domain Roode publishes to, and the
+// acquisition task for `--acquisition-task`.
+#define USE_BINARY_SENSOR
+#define USE_NUMBER
+#define USE_SENSOR
+#define USE_SWITCH
+#define USE_TEXT_SENSOR
+#define USE_ROODE_ACQUISITION_TASK
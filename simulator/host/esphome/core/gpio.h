@@ -0,0 +1,19 @@
+#pragma once
+#include <cstdint>
+
+namespace esphome {
+namespace gpio {
+enum InterruptType { INTERRUPT_RISING_EDGE = 1, INTERRUPT_FALLING_EDGE = 2, INTERRUPT_ANY_EDGE = 3 };
+}
+class GPIOPin {
+ public:
+  virtual void setup() {}
+  virtual void pin_mode(int) {}
+  virtual bool digital_read() { return false; }
+  virtual void digital_write(bool) {}
+};
+class InternalGPIOPin : public GPIOPin {
+ public:
+  virtual uint8_t get_pin() const { return 0; }
+};
+}  // namespace esphome
@@ -0,0 +1,28 @@
+#pragma once
+#include <cstdint>
+#include <thread>
+
+namespace esphome {
+/** The host build runs on a simulated clock, these advance it instead of sleeping. */
+uint32_t millis();
+uint32_t micros();
+void delay(uint32_t ms);
+void delayMicroseconds(uint32_t us);
+
+namespace host {
+uint64_t time_us();
+void advance_time(uint64_t us);
+void reset_time();
+/**
+ * Only the given thread advances the clock from now on, others wait for it to pass the time they would advance to.
+ * This keeps a second thread in step with the simulated main loop. Pass a default id to let every thread advance it.
+ */
+void set_clock_owner(std::thread::id owner);
+/** Waits for the other thread to wait for the clock for the first time, after which the two run in lockstep */
+void wait_for_other_thread();
+}  // namespace host
+}  // namespace esphome
+using esphome::delay;
+using esphome::delayMicroseconds;
+using esphome::micros;
+using esphome::millis;
@@ -0,0 +1,10 @@
+#pragma once
+#include <optional>
+
+namespace esphome {
+template<typename T> class optional : public std::optional<T> {
+ public:
+  using std::optional<T>::optional;
+  optional(std::nullopt_t) : std::optional<T>() {}
+};
+}  // namespace esphome
@@ -0,0 +1,40 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <vector>
+
+namespace esphome {
+class ESPPreferenceObject {
+ public:
+  ESPPreferenceObject() = default;
+  explicit ESPPreferenceObject(std::vector<uint8_t> *slot) : slot_(slot) {}
+  template<typename T> bool save(const T *src) {
+    if (this->slot_ == nullptr)
+      return false;
+    this->slot_->assign(reinterpret_cast<const uint8_t *>(src), reinterpret_cast<const uint8_t *>(src) + sizeof(T));
+    return true;
+  }
+  template<typename T> bool load(T *dest) {
+    if (this->slot_ == nullptr || this->slot_->size() != sizeof(T))
+      return false;
+    memcpy(dest, this->slot_->data(), sizeof(T));
+    return true;
+  }
+
+ protected:
+  std::vector<uint8_t> *slot_{nullptr};
+};
+
+class ESPPreferences {
+ public:
+  template<typename T> ESPPreferenceObject make_preference(uint32_t type, bool /*in_flash*/ = false) {
+    return ESPPreferenceObject(&this->slots_[type]);
+  }
+  bool sync() { return true; }
+
+ protected:
+  std::map<uint32_t, std::vector<uint8_t>> slots_;
+};
+extern ESPPreferences *global_preferences;  // NOLINT
+}  // namespace esphome
@@ -0,0 +1,58 @@
+#pragma once
+#include <cstdint>
+
+namespace esphome {
+namespace host {
+
+enum class I2CFault : uint8_t {
+  None,
+  /** The device doesn't acknowledge, the transaction fails right away */
+  Nack,
+  /** The device stretches the clock until the bus times out */
+  Timeout,
+  /** The transaction succeeds, but some bits of the data read are flipped */
+  CorruptRead,
+};
+
+struct I2CStats {
+  uint32_t transactions{0};
+  /** Bytes on the wire, including the address & register index */
+  uint32_t bytes{0};
+  uint32_t faults{0};
+  /** Measurement cycles, each ending with ranging being stopped */
+  uint32_t cycles{0};
+  uint32_t max_cycle_transactions{0};
+  uint32_t max_cycle_bytes{0};
+};
+
+/**
+ * The bus the host VL53L1X_ULD talks over. Every register access of the driver is a transaction here, which takes
+ * simulated time, is counted and may be failed on purpose to exercise the error handling above the driver.
+ */
+class MockI2C {
+ public:
+  /** 9 clock cycles per byte at 400kHz */
+  static constexpr uint32_t BYTE_US = 23;
+  /** Start, stop & driver overhead per transaction */
+  static constexpr uint32_t TRANSACTION_US = 20;
+  /** How long a stalled transaction blocks before giving up, the Arduino Wire default */
+  static constexpr uint32_t STALL_US = 50000;
+
+  /** Clears the stats, faults & fault rates and reseeds the random faults */
+  static void reset(uint32_t seed);
+  static void reset_stats();
+  static const I2CStats &get_stats();
+  /** Chance of the fault per transaction, in faults per million transactions */
+  static void set_fault_rate(I2CFault fault, uint32_t per_million);
+  /** Fails the transaction `after` transactions from now with the fault */
+  static void inject(I2CFault fault, uint32_t after = 0);
+  /** Called by the driver once a measurement cycle is done */
+  static void end_cycle();
+
+  static I2CFault write(uint8_t address, uint16_t reg, uint8_t size);
+  /** `value` holds what the device would answer, which a corrupt read changes */
+  static I2CFault read(uint8_t address, uint16_t reg, uint8_t size, uint32_t &value);
+};
+
+}  // namespace host
+}  // namespace esphome
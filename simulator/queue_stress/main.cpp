@@ -0,0 +1,157 @@
+/**
+ * Stress test of the queue handing acquisition events over to the main loop (components/roode/spsc_queue.h).
+ *
+ * Unlike the simulator, which runs acquisition & the main loop in lockstep, a producer & a consumer thread run freely
+ * here, with the consumer stalling now & then so the queue overflows. Every item carries its sequence number twice, so
+ * torn or reordered items show up. Checked are that items arrive in the order they were pushed, that every item pushed
+ * arrives exactly once and that the drop count matches the pushes that failed. The waiting producer, as used for
+ * control events, must not lose anything. Build with -fsanitize=thread to check the memory ordering as well.
+ * Exits with an error if a check fails.
+ */
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+
+#include "roode/spsc_queue.h"
+
+using esphome::roode::SpscQueue;
+
+namespace {
+
+struct Item {
+  uint32_t sequence;
+  uint32_t check;
+};
+
+struct Options {
+  uint32_t items = 100000;
+  uint32_t burst = 48;
+  uint32_t stall_every = 1000;
+  uint32_t stall_us = 200;
+};
+
+struct Result {
+  uint32_t pushed = 0;
+  uint32_t failed = 0;
+  uint32_t received = 0;
+  uint32_t dropped = 0;
+  uint32_t errors = 0;
+};
+
+/**
+ * Pushes `options.items` items, either dropping them on a full queue like samples or waiting for room like control
+ * events, while the consumer pops them as they come.
+ */
+template<size_t N> Result run(const Options &options, bool wait_for_room) {
+  SpscQueue<Item, N> queue{};
+  std::atomic<bool> done{false};
+  Result result{};
+
+  std::thread producer([&] {
+    for (uint32_t sequence = 0; sequence < options.items; sequence++) {
+      while (wait_for_room && queue.is_full()) {
+        std::this_thread::yield();
+      }
+      if (queue.push({sequence, ~sequence})) {
+        result.pushed++;
+      } else {
+        result.failed++;
+      }
+      if (sequence % options.burst == 0) {
+        // gives the consumer a chance to keep up, so the queue is neither always full nor always empty
+        std::this_thread::yield();
+      }
+    }
+    done.store(true, std::memory_order_release);
+  });
+
+  std::thread consumer([&] {
+    int64_t last = -1;
+    Item item{};
+    while (true) {
+      // checked before popping, so whatever was pushed before the producer finished is still popped
+      bool finished = done.load(std::memory_order_acquire);
+      bool popped = false;
+      while (queue.pop(item)) {
+        popped = true;
+        if (item.check != ~item.sequence || int64_t(item.sequence) <= last) {
+          if (result.errors++ < 10) {
+            fprintf(stderr, "item %u (check %08x) after %lld\n", item.sequence, item.check, (long long) last);
+          }
+        }
+        last = item.sequence;
+        if (++result.received % options.stall_every == 0) {
+          // like a main loop busy with something else
+          std::this_thread::sleep_for(std::chrono::microseconds(options.stall_us));
+        }
+      }
+      if (finished && !popped) {
+        break;
+      }
+      if (!popped) {
+        std::this_thread::yield();
+      }
+    }
+  });
+
+  producer.join();
+  consumer.join();
+  result.dropped = queue.get_dropped();
+  return result;
+}
+
+bool check(const char *name, const Result &result, const Options &options, bool wait_for_room) {
+  bool ok = result.errors == 0 && result.pushed + result.failed == options.items &&
+            result.received == result.pushed && result.dropped == result.failed && (!wait_for_room || result.failed == 0);
+  printf("%s,%u,%u,%u,%u,%s\n", name, result.pushed, result.received, result.dropped, result.errors,
+         ok ? "ok" : "FAILED");
+  return ok;
+}
+
+bool parse_options(int argc, char **argv, Options &options) {
+  for (int i = 1; i < argc; i++) {
+    std::string name = argv[i];
+    if (i + 1 >= argc) {
+      return false;
+    }
+    uint32_t value = strtoul(argv[++i], nullptr, 10);
+    if (name == "--items") {
+      options.items = value;
+    } else if (name == "--burst") {
+      options.burst = value > 0 ? value : 1;
+    } else if (name == "--stall-every") {
+      options.stall_every = value > 0 ? value : 1;
+    } else if (name == "--stall-us") {
+      options.stall_us = value;
+    } else {
+      return false;
+    }
+  }
+  return true;
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  Options options;
+  if (!parse_options(argc, argv, options)) {
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "  --items N                items pushed per scenario (100000)\n"
+            "  --burst N                the producer pushes N items between yielding (48)\n"
+            "  --stall-every N          the consumer stalls after every N items (1000)\n"
+            "  --stall-us US            length of a stall (200)\n",
+            argv[0]);
+    return 1;
+  }
+  bool ok = true;
+  printf("scenario,pushed,received,dropped,errors,result\n");
+  // the capacities of the sample & control queues in Roode
+  ok &= check("samples", run<64>(options, false), options, false);
+  ok &= check("control", run<32>(options, true), options, true);
+  return ok ? 0 : 2;
+}
@@ -0,0 +1,318 @@
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+#include "esphome/core/application.h"
+#include "esphome/core/hal.h"
+#include "esphome/core/log.h"
+#include "esphome/core/preferences.h"
+#include "VL53L1X_ULD.h"
+#include "mock_i2c.h"
+
+namespace esphome {
+
+Application App;  // NOLINT
+ESPPreferences *global_preferences = new ESPPreferences();  // NOLINT
+int host_log_level = ESPHOME_LOG_LEVEL_WARN;  // NOLINT
+
+/** Advanced by whichever thread is ranging, which is the acquisition task if enabled */
+static std::atomic<uint64_t> simulated_time_us{0};
+
+/** Thread driving the clock, the other one waits for it. Anybody drives the clock when unset. */
+static std::atomic<std::thread::id> clock_owner{};
+/** Time the other thread waits for, 0 while it is running */
+static std::atomic<uint64_t> waiter_target{0};
+static std::atomic<bool> has_waiter{false};
+
+uint32_t millis() { return simulated_time_us / 1000; }
+uint32_t micros() { return simulated_time_us; }
+void delay(uint32_t ms) { host::advance_time(uint64_t(ms) * 1000); }
+void delayMicroseconds(uint32_t us) { host::advance_time(us); }
+
+namespace host {
+uint64_t time_us() { return simulated_time_us; }
+/**
+ * With a clock owner, both threads run in lockstep: the owner only moves the clock up to the time the other thread
+ * waits for, and then waits for it to get to its next wait, as if the code between waits took no time at all.
+ */
+void advance_time(uint64_t us) {
+  uint64_t target = simulated_time_us + us;
+  auto owner = clock_owner.load();
+  if (owner == std::thread::id()) {
+    simulated_time_us += us;
+    return;
+  }
+  if (owner != std::this_thread::get_id()) {
+    has_waiter = true;
+    waiter_target = target;
+    while (simulated_time_us < target && clock_owner.load() != std::thread::id()) {
+      std::this_thread::yield();
+    }
+    waiter_target = 0;
+    if (simulated_time_us < target) {
+      simulated_time_us = target;
+    }
+    return;
+  }
+  while (simulated_time_us < target) {
+    if (!has_waiter) {
+      simulated_time_us = target;
+      return;
+    }
+    uint64_t waiting_for;
+    while ((waiting_for = waiter_target) <= simulated_time_us) {
+      std::this_thread::yield();
+    }
+    simulated_time_us = std::min(target, waiting_for);
+  }
+}
+void reset_time() {
+  simulated_time_us = 0;
+  has_waiter = false;
+  waiter_target = 0;
+}
+void set_clock_owner(std::thread::id owner) { clock_owner = owner; }
+void wait_for_other_thread() {
+  while (!has_waiter) {
+    std::this_thread::yield();
+  }
+}
+}  // namespace host
+
+}  // namespace esphome
+
+std::function<uint16_t(const RangingContext &)> VL53L1X_ULD::scene;  // NOLINT
+
+using esphome::host::I2CFault;
+using esphome::host::MockI2C;
+
+// Registers accessed by the driver calls below
+static const uint16_t I2C_SLAVE__DEVICE_ADDRESS = 0x0001;
+static const uint16_t VHV_CONFIG__TIMEOUT_MACROP_LOOP_BOUND = 0x0008;
+static const uint16_t VHV_CONFIG__INIT = 0x000B;
+static const uint16_t ALGO__CROSSTALK_COMPENSATION_PLANE_OFFSET_KCPS = 0x0016;
+static const uint16_t ALGO__CROSSTALK_COMPENSATION_X_PLANE_GRADIENT_KCPS = 0x0018;
+static const uint16_t ALGO__CROSSTALK_COMPENSATION_Y_PLANE_GRADIENT_KCPS = 0x001A;
+static const uint16_t ALGO__PART_TO_PART_RANGE_OFFSET_MM = 0x001E;
+static const uint16_t MM_CONFIG__INNER_OFFSET_MM = 0x0020;
+static const uint16_t MM_CONFIG__OUTER_OFFSET_MM = 0x0022;
+static const uint16_t DEFAULT_CONFIGURATION_START = 0x002D;
+static const uint16_t GPIO_HV_MUX__CTRL = 0x0030;
+static const uint16_t GPIO__TIO_HV_STATUS = 0x0031;
+static const uint16_t PHASECAL_CONFIG__TIMEOUT_MACROP = 0x004B;
+static const uint16_t RANGE_CONFIG__TIMEOUT_MACROP_A_HI = 0x005E;
+static const uint16_t RANGE_CONFIG__VCSEL_PERIOD_A = 0x0060;
+static const uint16_t RANGE_CONFIG__TIMEOUT_MACROP_B_HI = 0x0061;
+static const uint16_t RANGE_CONFIG__VCSEL_PERIOD_B = 0x0063;
+static const uint16_t RANGE_CONFIG__VALID_PHASE_HIGH = 0x0069;
+static const uint16_t SYSTEM__INTERRUPT_CONFIG_GPIO = 0x0046;
+static const uint16_t SYSTEM__INTERMEASUREMENT_PERIOD = 0x006C;
+static const uint16_t SYSTEM__THRESH_HIGH = 0x0072;
+static const uint16_t SYSTEM__THRESH_LOW = 0x0074;
+static const uint16_t SD_CONFIG__WOI_SD0 = 0x0078;
+static const uint16_t SD_CONFIG__INITIAL_PHASE_SD0 = 0x007A;
+static const uint16_t ROI_CONFIG__USER_ROI_CENTRE_SPAD = 0x007F;
+static const uint16_t ROI_CONFIG__USER_ROI_REQUESTED_GLOBAL_XY_SIZE = 0x0080;
+static const uint16_t SYSTEM__INTERRUPT_CLEAR = 0x0086;
+static const uint16_t SYSTEM__MODE_START = 0x0087;
+static const uint16_t RESULT__FINAL_CROSSTALK_CORRECTED_RANGE_MM_SD0 = 0x0096;
+static const uint16_t RESULT__OSC_CALIBRATE_VAL = 0x00DE;
+static const uint16_t FIRMWARE__SYSTEM_STATUS = 0x00E5;
+static const uint16_t ROI_CONFIG__MODE_ROI_CENTRE_SPAD = 0x013E;
+
+static VL53L1_Error to_error(I2CFault fault) {
+  switch (fault) {
+    case I2CFault::Nack:
+      return VL53L1_ERROR_CONTROL_INTERFACE;
+    case I2CFault::Timeout:
+      return VL53L1_ERROR_TIME_OUT;
+    default:
+      return VL53L1_ERROR_NONE;
+  }
+}
+
+VL53L1_Error VL53L1X_ULD::write_(uint16_t reg, uint8_t size, VL53L1_Error status) {
+  auto error = to_error(MockI2C::write(this->address_ >> 1, reg, size));
+  return status != VL53L1_ERROR_NONE ? status : error;
+}
+
+VL53L1_Error VL53L1X_ULD::read_(uint16_t reg, uint8_t size, uint32_t &value, VL53L1_Error status) {
+  auto error = to_error(MockI2C::read(this->address_ >> 1, reg, size, value));
+  return status != VL53L1_ERROR_NONE ? status : error;
+}
+
+VL53L1_Error VL53L1X_ULD::SetI2CAddress(uint8_t address) {
+  auto status = this->write_(I2C_SLAVE__DEVICE_ADDRESS, 1);
+  if (status == VL53L1_ERROR_NONE) {
+    this->address_ = address;
+  }
+  return status;
+}
+
+/** Writes the default configuration and waits for a first measurement, polling without a timeout like the driver */
+VL53L1_Error VL53L1X_ULD::Init() {
+  VL53L1_Error status = VL53L1_ERROR_NONE;
+  for (uint16_t reg = DEFAULT_CONFIGURATION_START; reg <= SYSTEM__MODE_START; reg++) {
+    status = this->write_(reg, 1, status);
+  }
+  // The driver polls for the first measurement forever, so unlike StartRanging a lost start isn't modelled here
+  status = this->write_(SYSTEM__MODE_START, 1, status);
+  this->ranging_started_us_ = esphome::host::time_us();
+  uint8_t ready = 0;
+  while (!ready) {
+    status = this->CheckForDataReady(&ready) ?: status;
+  }
+  status = this->write_(SYSTEM__INTERRUPT_CLEAR, 1, status);
+  status = this->write_(SYSTEM__MODE_START, 1, status);
+  status = this->write_(VHV_CONFIG__TIMEOUT_MACROP_LOOP_BOUND, 1, status);
+  return this->write_(VHV_CONFIG__INIT, 1, status);
+}
+
+VL53L1_Error VL53L1X_ULD::GetBootState(uint8_t *state) {
+  uint32_t value = 1;
+  auto status = this->read_(FIRMWARE__SYSTEM_STATUS, 1, value);
+  *state = value;
+  return status;
+}
+
+VL53L1_Error VL53L1X_ULD::SetOffsetInMm(int16_t) {
+  auto status = this->write_(ALGO__PART_TO_PART_RANGE_OFFSET_MM, 2);
+  status = this->write_(MM_CONFIG__INNER_OFFSET_MM, 2, status);
+  return this->write_(MM_CONFIG__OUTER_OFFSET_MM, 2, status);
+}
+
+VL53L1_Error VL53L1X_ULD::SetXTalk(uint16_t) {
+  auto status = this->write_(ALGO__CROSSTALK_COMPENSATION_X_PLANE_GRADIENT_KCPS, 2);
+  status = this->write_(ALGO__CROSSTALK_COMPENSATION_Y_PLANE_GRADIENT_KCPS, 2, status);
+  return this->write_(ALGO__CROSSTALK_COMPENSATION_PLANE_OFFSET_KCPS, 2, status);
+}
+
+/** The driver reads the timing budget, writes the distance mode and then applies the timing budget again */
+VL53L1_Error VL53L1X_ULD::SetDistanceMode(EDistanceMode mode) {
+  uint32_t timing_budget = this->context_.timing_budget;
+  auto status = this->read_(RANGE_CONFIG__TIMEOUT_MACROP_A_HI, 2, timing_budget);
+  for (uint16_t reg : {PHASECAL_CONFIG__TIMEOUT_MACROP, RANGE_CONFIG__VCSEL_PERIOD_A, RANGE_CONFIG__VCSEL_PERIOD_B,
+                       RANGE_CONFIG__VALID_PHASE_HIGH}) {
+    status = this->write_(reg, 1, status);
+  }
+  status = this->write_(SD_CONFIG__WOI_SD0, 2, status);
+  status = this->write_(SD_CONFIG__INITIAL_PHASE_SD0, 2, status);
+  this->context_.distance_mode = mode;
+  return this->SetTimingBudgetInMs(this->context_.timing_budget) ?: status;
+}
+
+VL53L1_Error VL53L1X_ULD::SetTimingBudgetInMs(uint16_t timing_budget) {
+  uint32_t mode = this->context_.distance_mode;
+  auto status = this->read_(PHASECAL_CONFIG__TIMEOUT_MACROP, 1, mode);
+  status = this->write_(RANGE_CONFIG__TIMEOUT_MACROP_A_HI, 2, status);
+  status = this->write_(RANGE_CONFIG__TIMEOUT_MACROP_B_HI, 2, status);
+  this->context_.timing_budget = timing_budget;
+  return status;
+}
+
+VL53L1_Error VL53L1X_ULD::SetInterMeasurementInMs(uint32_t inter_measurement) {
+  this->inter_measurement_ms_ = inter_measurement;
+  uint32_t clock_pll = 0;
+  auto status = this->read_(RESULT__OSC_CALIBRATE_VAL, 2, clock_pll);
+  return this->write_(SYSTEM__INTERMEASUREMENT_PERIOD, 4, status);
+}
+
+VL53L1_Error VL53L1X_ULD::SetROI(uint16_t width, uint16_t height) {
+  uint32_t optical_center = 199;
+  auto status = this->read_(ROI_CONFIG__MODE_ROI_CENTRE_SPAD, 1, optical_center);
+  status = this->write_(ROI_CONFIG__USER_ROI_REQUESTED_GLOBAL_XY_SIZE, 1, status);
+  this->context_.roi_width = width;
+  this->context_.roi_height = height;
+  return status;
+}
+
+VL53L1_Error VL53L1X_ULD::SetROICenter(uint8_t center) {
+  this->context_.roi_center = center;
+  return this->write_(ROI_CONFIG__USER_ROI_CENTRE_SPAD, 1);
+}
+
+VL53L1_Error VL53L1X_ULD::StartRanging() {
+  auto status = this->write_(SYSTEM__MODE_START, 1);
+  // a failed write leaves the sensor idle, so data never gets ready
+  this->ranging_started_us_ = status == VL53L1_ERROR_NONE ? esphome::host::time_us() : UINT64_MAX / 2;
+  this->measurements_checked_ = 0;
+  this->threshold_reached_ = false;
+  return status;
+}
+
+VL53L1_Error VL53L1X_ULD::StopRanging() {
+  auto status = this->write_(SYSTEM__MODE_START, 1);
+  MockI2C::end_cycle();
+  return status;
+}
+
+/**
+ * Reads the interrupt polarity and then the interrupt status, which matches the polarity once data is ready.
+ * With a distance threshold, data is only ready once a measurement met it. Ranging is continuous then, every
+ * measurement since the last check is taken from the scene.
+ */
+VL53L1_Error VL53L1X_ULD::CheckForDataReady(uint8_t *ready) {
+  uint32_t polarity = 0x01;
+  auto status = this->read_(GPIO_HV_MUX__CTRL, 1, polarity);
+  uint64_t first_us = this->ranging_started_us_ + uint64_t(this->context_.timing_budget) * 1000;
+  uint64_t now_us = esphome::host::time_us();
+  uint32_t interrupt = now_us >= first_us;
+  if (this->threshold_enabled_ && interrupt && !this->threshold_reached_) {
+    uint64_t period_us = uint64_t(std::max<uint32_t>(this->inter_measurement_ms_, this->context_.timing_budget)) * 1000;
+    uint32_t measurements = (now_us - first_us) / period_us + 1;
+    while (this->measurements_checked_ < measurements && !this->threshold_reached_) {
+      this->context_.time_us = first_us + this->measurements_checked_++ * period_us;
+      uint16_t distance = scene ? scene(this->context_) : 0;
+      bool below = distance < this->threshold_low_;
+      bool above = distance > this->threshold_high_;
+      switch (this->threshold_window_) {
+        case Below:
+          this->threshold_reached_ = below;
+          break;
+        case Above:
+          this->threshold_reached_ = above;
+          break;
+        case Out:
+          this->threshold_reached_ = below || above;
+          break;
+        case In:
+          this->threshold_reached_ = !below && !above;
+          break;
+      }
+    }
+  }
+  if (this->threshold_enabled_) {
+    interrupt = this->threshold_reached_;
+  }
+  status = this->read_(GPIO__TIO_HV_STATUS, 1, interrupt, status);
+  *ready = (interrupt & 0x01) == !(polarity & 0x10);
+  return status;
+}
+
+VL53L1_Error VL53L1X_ULD::GetDistanceInMm(uint16_t *distance) {
+  this->context_.time_us = esphome::host::time_us();
+  uint32_t value = scene ? scene(this->context_) : 0;
+  auto status = this->read_(RESULT__FINAL_CROSSTALK_CORRECTED_RANGE_MM_SD0, 2, value);
+  *distance = value;
+  return status;
+}
+
+VL53L1_Error VL53L1X_ULD::ClearInterrupt() {
+  this->threshold_reached_ = false;
+  return this->write_(SYSTEM__INTERRUPT_CLEAR, 1);
+}
+
+VL53L1_Error VL53L1X_ULD::SetDistanceThreshold(uint16_t low, uint16_t high, EWindowMode window,
+                                               uint8_t interrupt_on_no_target) {
+  uint32_t config = 0x20;
+  auto status = this->read_(SYSTEM__INTERRUPT_CONFIG_GPIO, 1, config);
+  status = this->write_(SYSTEM__INTERRUPT_CONFIG_GPIO, 1, status);
+  status = this->write_(SYSTEM__THRESH_HIGH, 2, status);
+  status = this->write_(SYSTEM__THRESH_LOW, 2, status);
+  // below the largest distance, or no target at all, is every measurement: no need to take them from the scene
+  this->threshold_enabled_ = !(window == Below && low == UINT16_MAX && interrupt_on_no_target);
+  this->threshold_low_ = low;
+  this->threshold_high_ = high;
+  this->threshold_window_ = window;
+  return status;
+}
@@ -0,0 +1,456 @@
+/**
+ * Roode crowd simulator
+ *
+ * Generates synthetic crossings and runs the resulting per zone distance streams through the real Roode & Zone code,
+ * using a simulated clock and VL53L1X. The result is a matrix of counting accuracy per ranging mode, sampling size and
+ * loop interval, which helps choosing timing budgets and sampling for a site before installing hardware.
+ */
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "mock_i2c.h"
+#include "roode/roode.h"
+#include "scenario.h"
+
+using esphome::roode::Orientation;
+using esphome::roode::Roode;
+using esphome::host::I2CFault;
+using esphome::host::MockI2C;
+using esphome::vl53l1x::RangingMode;
+namespace host = esphome::host;
+
+namespace simulator {
+
+struct Options {
+  uint32_t runs = 100;
+  uint32_t seed = 1;
+  uint16_t mounting_height = 2200;
+  uint16_t frame_offset = 0;
+  /** ROI width override, 0 for auto */
+  uint8_t roi_width = 6;
+  Orientation orientation = esphome::roode::Parallel;
+  std::vector<const RangingMode *> ranging_modes{std::begin(esphome::vl53l1x::Ranging::All),
+                                                 std::end(esphome::vl53l1x::Ranging::All)};
+  std::vector<uint8_t> sampling{1, 2, 3, 5};
+  /** ESPHome runs the main loop every 16ms by default */
+  std::vector<uint32_t> loop_intervals{16, 50};
+  /** Time the other components take per loop iteration */
+  uint32_t loop_overhead_ms = 2;
+  bool acquisition_task = false;
+  /** Idle after nobody was seen for this long, 0 to always range both zones */
+  uint32_t idle_after_ms = 0;
+  /** Injected I2C faults per million transactions, once setup finished */
+  uint32_t nack_rate = 0;
+  uint32_t timeout_rate = 0;
+  uint32_t corrupt_rate = 0;
+  /** Limits checked after every configuration, 0 to not check */
+  float i2c_budget = 0;
+  uint32_t max_blocking_ms = 0;
+  /** File the raw stream of every run is appended to, if any */
+  FILE *raw_stream = nullptr;
+  /** File the crossings of every run are appended to, as labels for the raw stream, if any */
+  FILE *labels = nullptr;
+  /** Path prefix of the event log every run appends to, if any */
+  std::string event_log;
+  ScenarioParameters scenario;
+};
+
+struct Configuration {
+  const RangingMode *ranging_mode;
+  uint8_t sampling;
+  uint32_t loop_interval_ms;
+};
+
+struct RunResult {
+  int delta;
+  uint32_t samples;
+  /** Time between the last person crossing below the sensor and the last counter update */
+  int32_t latency_ms;
+  esphome::host::I2CStats i2c;
+  /** Longest main loop iteration */
+  uint32_t max_loop_ms;
+  /** Time spent idle and total time, while the scenario played */
+  uint64_t idle_ms;
+  uint64_t total_ms;
+  /** Since boot, calibration included */
+  float energy_per_hour;
+};
+
+/** People counter which remembers when it was last changed */
+class HostNumber : public esphome::number::Number {
+ public:
+  uint64_t last_change_us{0};
+
+ protected:
+  void control(float value) override {
+    this->last_change_us = host::time_us();
+    this->publish_state(value);
+  }
+};
+
+/** Appends the raw stream packets to a file, in the same format as the UART & TCP transports */
+class FileTransport : public esphome::roode::RawStreamTransport {
+ public:
+  explicit FileTransport(FILE *file) : file(file) {}
+  void write(const uint8_t *data, size_t length) override { fwrite(data, 1, length, this->file); }
+
+ protected:
+  FILE *file;
+};
+
+RunResult run(const Options &options, const Configuration &configuration, const Scenario &scenario, uint32_t seed) {
+  host::reset_time();
+  MockI2C::reset(seed);
+  Scene scene(scenario, options.mounting_height, options.orientation, seed);
+  scene.set_frame_offset(options.frame_offset);
+  std::atomic<uint32_t> readings{0};
+  VL53L1X_ULD::scene = [&scene, &readings](const RangingContext &context) {
+    readings++;
+    return scene.measure(context);
+  };
+
+  auto sensor = std::make_unique<esphome::vl53l1x::VL53L1X>();
+  sensor->set_timeout(2000);
+  sensor->set_ranging_mode_override(configuration.ranging_mode);
+  sensor->setup();
+
+  // Same defaults as the codegen in components/roode/__init__.py
+  auto roode = std::make_unique<Roode>();
+  HostNumber counter;
+  counter.publish_state(100);
+  roode->set_tof_sensor(sensor.get());
+  roode->set_orientation(options.orientation);
+  roode->set_sampling_size(configuration.sampling);
+  roode->set_persist_calibration(false);
+  roode->set_acquisition_task(options.acquisition_task);
+  roode->set_idle_after(options.idle_after_ms);
+  roode->set_people_counter(&counter);
+  std::unique_ptr<FileTransport> transport;
+  std::unique_ptr<esphome::roode::RawStream> raw_stream;
+  if (options.raw_stream != nullptr) {
+    transport = std::make_unique<FileTransport>(options.raw_stream);
+    raw_stream = std::make_unique<esphome::roode::RawStream>(transport.get());
+    raw_stream->set_enabled(true);
+    roode->set_raw_stream(raw_stream.get());
+  }
+  std::unique_ptr<esphome::roode::EventLog> event_log;
+  if (!options.event_log.empty()) {
+    // picks up where the previous run left off, like after a reboot
+    event_log = std::make_unique<esphome::roode::EventLog>(options.event_log);
+    event_log->set_max_records(256);
+    roode->set_event_log(event_log.get());
+  }
+  for (auto *zone : {&roode->entry, &roode->exit}) {
+    zone->roi_override.set_width(options.roi_width);
+    zone->roi_override.set_height(16);
+    zone->threshold.set_min_percentage(0);
+    zone->threshold.set_max_percentage(85);
+  }
+  if (options.acquisition_task) {
+    // the task starts at the end of setup, from then on it has to keep in step with the main loop
+    host::set_clock_owner(std::this_thread::get_id());
+  }
+  roode->setup();
+  if (options.acquisition_task) {
+    host::wait_for_other_thread();
+  }
+  // only the steady state is accounted for, not calibration
+  MockI2C::reset_stats();
+  MockI2C::set_fault_rate(I2CFault::Nack, options.nack_rate);
+  MockI2C::set_fault_rate(I2CFault::Timeout, options.timeout_rate);
+  MockI2C::set_fault_rate(I2CFault::CorruptRead, options.corrupt_rate);
+
+  auto idle_before = roode->get_power_state_time(esphome::roode::PowerState::Idle);
+  auto active_before = roode->get_power_state_time(esphome::roode::PowerState::Active);
+  uint64_t scene_origin = host::time_us();
+  scene.set_origin(scene_origin);
+  uint64_t end_us = host::time_us() + uint64_t(scenario.duration_ms) * 1000;
+  uint32_t readings_before = readings;
+  uint64_t max_loop_us = 0;
+  while (host::time_us() < end_us) {
+    uint64_t iteration_start = host::time_us();
+    roode->loop();
+    max_loop_us = std::max(max_loop_us, host::time_us() - iteration_start);
+    host::advance_time(uint64_t(options.loop_overhead_ms) * 1000);
+    uint64_t next_iteration = iteration_start + uint64_t(configuration.loop_interval_ms) * 1000;
+    if (host::time_us() < next_iteration) {
+      host::advance_time(next_iteration - host::time_us());
+    }
+  }
+  // lets the task finish its last reading
+  host::set_clock_owner({});
+  roode->on_shutdown();
+  uint32_t samples = readings - readings_before;
+  if (raw_stream != nullptr) {
+    // flushes the last packet
+    raw_stream->set_enabled(false);
+  }
+  uint32_t crossed_at = 0;
+  for (const auto &person : scenario.people) {
+    if (!person.is_pet) {
+      crossed_at = std::max(crossed_at, person.crossed_at());
+    }
+  }
+  if (options.labels != nullptr) {
+    // the raw stream of every run starts at the same time again, which is how the classifier tells them apart
+    static uint32_t labelled_runs = 0;
+    for (const auto &person : scenario.people) {
+      int direction = person.turns_back || person.is_pet ? 0 : (person.end_x > person.start_x ? -1 : 1);
+      fprintf(options.labels, "%u,%u,%d\n", labelled_runs, uint32_t(scene_origin + uint64_t(person.crossed_at()) * 1000),
+              direction);
+    }
+    labelled_runs++;
+  }
+  int32_t latency_ms = int64_t(counter.last_change_us - scene_origin) / 1000 - crossed_at;
+  uint64_t idle_ms = roode->get_power_state_time(esphome::roode::PowerState::Idle) - idle_before;
+  uint64_t total_ms = idle_ms + roode->get_power_state_time(esphome::roode::PowerState::Active) - active_before;
+  return {int(counter.state) - 100, samples, latency_ms, MockI2C::get_stats(), uint32_t(max_loop_us / 1000), idle_ms,
+          total_ms, roode->get_energy_per_hour()};
+}
+
+static std::vector<uint32_t> parse_list(const char *value) {
+  std::vector<uint32_t> result;
+  for (char *end; *value != '\0'; value = *end == ',' ? end + 1 : end) {
+    result.push_back(strtoul(value, &end, 10));
+    if (end == value) {
+      break;
+    }
+  }
+  return result;
+}
+
+static void usage() {
+  fprintf(stderr,
+          "Usage: simulator [options]\n"
+          "  --runs N                 scenarios per configuration (100)\n"
+          "  --seed N                 random seed, the same scenarios are used for every configuration (1)\n"
+          "  --mounting-height MM     distance from the sensor to the floor (2200)\n"
+          "  --frame-offset MM        door frame seen by the entry side of an off-center mount, starting this far\n"
+          "                           from the optical center and 300mm below the sensor (none)\n"
+          "  --roi-width N            ROI width override, 0 for auto (6)\n"
+          "  --perpendicular          sensor pads are perpendicular to the doorway\n"
+          "  --ranging LIST           timing budgets in ms of the ranging modes to test (15,20,33,50,100,200)\n"
+          "  --sampling LIST          sampling sizes to test (1,2,3,5)\n"
+          "  --loop-interval LIST     main loop intervals in ms to test (16,50)\n"
+          "  --loop-overhead MS       time other components take per loop (2)\n"
+          "  --speed MIN,MAX          walking speed in mm/s (500,1800)\n"
+          "  --height MIN,MAX         person height in mm (1500,1950)\n"
+          "  --offset MM              maximum lateral offset from the center of the door (300)\n"
+          "  --group-size N           maximum number of people walking together (3)\n"
+          "  --group-probability P    chance a scenario is a group, in percent (30)\n"
+          "  --stop-probability P     chance a person stops in the doorway, in percent (20)\n"
+          "  --max-stop MS            longest stop in the doorway (3000)\n"
+          "  --turn-back-probability P  chance a person turns around in the doorway, in percent (0)\n"
+          "  --pet-probability P      chance a pet (250-600mm tall) walks through as well, in percent (0)\n"
+          "  --raw-stream FILE        append the raw stream of every run to FILE\n"
+          "  --labels FILE            append when every person crossed to FILE, as run,timestamp_us,direction lines\n"
+          "                           matching the raw stream, for training the classifier\n"
+          "  --event-log PATH         log the crossings of every run to PATH0.bin & PATH1.bin (256 records)\n"
+          "  --acquisition-task       range & track in a thread of its own, handing events over to the main loop\n"
+          "  --idle-after MS          idle after nobody was seen for MS, adds the idle share & estimated mWh per hour\n"
+          "  --i2c-faults N,T,C       NACKs, timeouts & corrupt reads injected per million I2C transactions (0,0,0)\n"
+          "  --i2c-budget N           fail if the I2C transactions per sample exceed N\n"
+          "  --max-blocking MS        fail if a main loop iteration takes longer than MS\n"
+          "  --verbose                log Roode's output\n");
+}
+
+static bool parse_options(int argc, char **argv, Options &options) {
+  for (int i = 1; i < argc; i++) {
+    std::string name = argv[i];
+    if (name == "--perpendicular") {
+      options.orientation = esphome::roode::Perpendicular;
+      continue;
+    }
+    if (name == "--acquisition-task") {
+      options.acquisition_task = true;
+      continue;
+    }
+    if (name == "--verbose") {
+      esphome::host_log_level = ESPHOME_LOG_LEVEL_DEBUG;
+      continue;
+    }
+    if (i + 1 >= argc) {
+      return false;
+    }
+    if (name == "--raw-stream") {
+      options.raw_stream = fopen(argv[++i], "wb");
+      if (options.raw_stream == nullptr) {
+        perror(argv[i]);
+        return false;
+      }
+      continue;
+    }
+    if (name == "--labels") {
+      options.labels = fopen(argv[++i], "w");
+      if (options.labels == nullptr) {
+        perror(argv[i]);
+        return false;
+      }
+      continue;
+    }
+    if (name == "--event-log") {
+      options.event_log = argv[++i];
+      continue;
+    }
+    auto values = parse_list(argv[++i]);
+    if (values.empty()) {
+      return false;
+    }
+    auto range = [&values](auto &min, auto &max) {
+      min = values.front();
+      max = values.back();
+    };
+    if (name == "--runs") {
+      options.runs = values[0];
+    } else if (name == "--seed") {
+      options.seed = values[0];
+    } else if (name == "--mounting-height") {
+      options.mounting_height = values[0];
+    } else if (name == "--frame-offset") {
+      options.frame_offset = values[0];
+    } else if (name == "--roi-width") {
+      options.roi_width = values[0];
+    } else if (name == "--ranging") {
+      options.ranging_modes.clear();
+      for (auto budget : values) {
+        for (const auto *mode : esphome::vl53l1x::Ranging::All) {
+          if (mode->timing_budget == budget) {
+            options.ranging_modes.push_back(mode);
+          }
+        }
+      }
+    } else if (name == "--sampling") {
+      options.sampling.assign(values.begin(), values.end());
+    } else if (name == "--loop-interval") {
+      options.loop_intervals = values;
+    } else if (name == "--loop-overhead") {
+      options.loop_overhead_ms = values[0];
+    } else if (name == "--speed") {
+      options.scenario.min_speed = values.front() / 1000.0f;
+      options.scenario.max_speed = values.back() / 1000.0f;
+    } else if (name == "--height") {
+      range(options.scenario.min_height, options.scenario.max_height);
+    } else if (name == "--offset") {
+      options.scenario.max_lateral_offset = values[0];
+    } else if (name == "--group-size") {
+      options.scenario.max_group_size = values[0];
+    } else if (name == "--group-probability") {
+      options.scenario.group_probability = values[0] / 100.0f;
+    } else if (name == "--stop-probability") {
+      options.scenario.stop_probability = values[0] / 100.0f;
+    } else if (name == "--max-stop") {
+      options.scenario.max_stop_ms = values[0];
+    } else if (name == "--i2c-faults") {
+      options.nack_rate = values[0];
+      options.timeout_rate = values.size() > 1 ? values[1] : 0;
+      options.corrupt_rate = values.size() > 2 ? values[2] : 0;
+    } else if (name == "--i2c-budget") {
+      options.i2c_budget = values[0];
+    } else if (name == "--idle-after") {
+      options.idle_after_ms = values[0];
+    } else if (name == "--max-blocking") {
+      options.max_blocking_ms = values[0];
+    } else if (name == "--turn-back-probability") {
+      options.scenario.turn_back_probability = values[0] / 100.0f;
+    } else if (name == "--pet-probability") {
+      options.scenario.pet_probability = values[0] / 100.0f;
+    } else {
+      return false;
+    }
+  }
+  return !options.ranging_modes.empty() && !options.sampling.empty() && !options.loop_intervals.empty();
+}
+
+}  // namespace simulator
+
+int main(int argc, char **argv) {
+  using namespace simulator;
+  Options options;
+  if (!parse_options(argc, argv, options)) {
+    usage();
+    return 1;
+  }
+
+  std::vector<Scenario> scenarios;
+  for (uint32_t i = 0; i < options.runs; i++) {
+    scenarios.push_back(generate_scenario(options.scenario, options.seed + i));
+  }
+
+  int exit_code = 0;
+  printf("ranging,timing_budget_ms,sampling,loop_interval_ms,runs,accuracy,mean_abs_error,samples_per_zone_per_s,"
+         "mean_latency_ms,i2c_transactions_per_sample,i2c_bytes_per_sample,max_i2c_transactions_per_cycle,i2c_faults,"
+         "max_loop_ms%s\n",
+         options.idle_after_ms > 0 ? ",idle_share,mwh_per_hour" : "");
+  for (const auto *mode : options.ranging_modes) {
+    for (auto sampling : options.sampling) {
+      for (auto loop_interval : options.loop_intervals) {
+        Configuration configuration{mode, sampling, loop_interval};
+        uint32_t correct = 0;
+        uint32_t error = 0;
+        uint64_t samples = 0;
+        uint64_t duration_ms = 0;
+        int64_t latency_ms = 0;
+        uint32_t counted = 0;
+        uint64_t transactions = 0;
+        uint64_t bytes = 0;
+        uint32_t max_cycle_transactions = 0;
+        uint32_t faults = 0;
+        uint32_t max_loop_ms = 0;
+        uint64_t idle_ms = 0;
+        uint64_t total_ms = 0;
+        float energy = 0;
+        for (uint32_t i = 0; i < scenarios.size(); i++) {
+          auto result = run(options, configuration, scenarios[i], options.seed + i);
+          correct += result.delta == scenarios[i].expected_delta;
+          error += std::abs(result.delta - scenarios[i].expected_delta);
+          samples += result.samples;
+          duration_ms += scenarios[i].duration_ms;
+          if (result.delta == scenarios[i].expected_delta && result.delta != 0) {
+            latency_ms += result.latency_ms;
+            counted++;
+          }
+          transactions += result.i2c.transactions;
+          bytes += result.i2c.bytes;
+          max_cycle_transactions = std::max(max_cycle_transactions, result.i2c.max_cycle_transactions);
+          faults += result.i2c.faults;
+          max_loop_ms = std::max(max_loop_ms, result.max_loop_ms);
+          idle_ms += result.idle_ms;
+          total_ms += result.total_ms;
+          energy += result.energy_per_hour;
+        }
+        float transactions_per_sample = samples > 0 ? float(transactions) / samples : 0.0f;
+        printf("%s,%u,%u,%u,%zu,%.3f,%.3f,%.1f,%.0f,%.1f,%.1f,%u,%u,%u", mode->name, mode->timing_budget, sampling,
+               loop_interval, scenarios.size(), float(correct) / scenarios.size(), float(error) / scenarios.size(),
+               samples / 2.0f / (duration_ms / 1000.0f), counted > 0 ? float(latency_ms) / counted : 0.0f,
+               transactions_per_sample, samples > 0 ? float(bytes) / samples : 0.0f, max_cycle_transactions, faults,
+               max_loop_ms);
+        if (options.idle_after_ms > 0) {
+          printf(",%.3f,%.1f", total_ms > 0 ? float(idle_ms) / total_ms : 0.0f, energy / scenarios.size());
+        }
+        printf("\n");
+        if (options.i2c_budget > 0 && transactions_per_sample > options.i2c_budget) {
+          fprintf(stderr, "%s, sampling %u, loop %ums: %.1f I2C transactions per sample exceed the budget of %.0f\n",
+                  mode->name, sampling, loop_interval, transactions_per_sample, options.i2c_budget);
+          exit_code = 2;
+        }
+        if (options.max_blocking_ms > 0 && max_loop_ms > options.max_blocking_ms) {
+          fprintf(stderr, "%s, sampling %u, loop %ums: a loop iteration took %ums, more than %ums\n", mode->name,
+                  sampling, loop_interval, max_loop_ms, options.max_blocking_ms);
+          exit_code = 2;
+        }
+      }
+    }
+  }
+  if (options.raw_stream != nullptr) {
+    fclose(options.raw_stream);
+  }
+  if (options.labels != nullptr) {
+    fclose(options.labels);
+  }
+  return exit_code;
+}
@@ -0,0 +1,113 @@
+#include "mock_i2c.h"
+
+#include <algorithm>
+#include <random>
+
+#include "esphome/core/hal.h"
+
+namespace esphome {
+namespace host {
+
+static I2CStats stats{};
+static uint32_t cycle_transactions = 0;
+static uint32_t cycle_bytes = 0;
+static uint32_t fault_rates[4] = {};
+static I2CFault injected_fault = I2CFault::None;
+static uint32_t injected_after = 0;
+static std::mt19937 rng;  // NOLINT
+
+void MockI2C::reset(uint32_t seed) {
+  reset_stats();
+  for (auto &rate : fault_rates) {
+    rate = 0;
+  }
+  injected_fault = I2CFault::None;
+  rng.seed(seed);
+}
+
+void MockI2C::reset_stats() {
+  stats = {};
+  cycle_transactions = 0;
+  cycle_bytes = 0;
+}
+
+const I2CStats &MockI2C::get_stats() { return stats; }
+
+void MockI2C::set_fault_rate(I2CFault fault, uint32_t per_million) {
+  fault_rates[static_cast<uint8_t>(fault)] = per_million;
+}
+
+void MockI2C::inject(I2CFault fault, uint32_t after) {
+  injected_fault = fault;
+  injected_after = after;
+}
+
+void MockI2C::end_cycle() {
+  stats.cycles++;
+  stats.max_cycle_transactions = std::max(stats.max_cycle_transactions, cycle_transactions);
+  stats.max_cycle_bytes = std::max(stats.max_cycle_bytes, cycle_bytes);
+  cycle_transactions = 0;
+  cycle_bytes = 0;
+}
+
+/** Counts the transaction, lets the time pass and picks the fault it fails with, if any */
+static I2CFault transfer(uint32_t bytes, bool is_read) {
+  stats.transactions++;
+  stats.bytes += bytes;
+  cycle_transactions++;
+  cycle_bytes += bytes;
+
+  I2CFault fault = I2CFault::None;
+  if (injected_fault != I2CFault::None && injected_after-- == 0) {
+    fault = injected_fault;
+    injected_fault = I2CFault::None;
+  } else {
+    uint32_t roll = rng() % 1000000;
+    for (auto candidate : {I2CFault::Nack, I2CFault::Timeout, I2CFault::CorruptRead}) {
+      uint32_t rate = fault_rates[static_cast<uint8_t>(candidate)];
+      if (roll < rate) {
+        fault = candidate;
+        break;
+      }
+      roll -= std::min(roll, rate);
+    }
+  }
+  if (fault == I2CFault::CorruptRead && !is_read) {
+    fault = I2CFault::None;
+  }
+  if (fault != I2CFault::None) {
+    stats.faults++;
+  }
+
+  switch (fault) {
+    case I2CFault::Nack:
+      // the address byte isn't acknowledged, nothing else is sent
+      advance_time(MockI2C::TRANSACTION_US + MockI2C::BYTE_US);
+      break;
+    case I2CFault::Timeout:
+      advance_time(MockI2C::STALL_US);
+      break;
+    default:
+      advance_time(MockI2C::TRANSACTION_US + bytes * MockI2C::BYTE_US);
+      break;
+  }
+  return fault;
+}
+
+I2CFault MockI2C::write(uint8_t /*address*/, uint16_t /*reg*/, uint8_t size) {
+  // address, 16 bit register index, data
+  return transfer(3 + size, false);
+}
+
+I2CFault MockI2C::read(uint8_t /*address*/, uint16_t /*reg*/, uint8_t size, uint32_t &value) {
+  // address & register index, repeated start with the address, data
+  auto fault = transfer(4 + size, true);
+  if (fault == I2CFault::CorruptRead) {
+    uint32_t mask = size >= 4 ? UINT32_MAX : (1UL << (8 * size)) - 1;
+    value ^= (rng() & mask) | 1;
+  }
+  return fault;
+}
+
+}  // namespace host
+}  // namespace esphome
@@ -0,0 +1,185 @@
+#include "scenario.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace simulator {
+
+/** Full field of view of the 16x16 SPAD array */
+static const float FIELD_OF_VIEW = 27.0f * M_PI / 180.0f;
+static const float SPAD_ANGLE = FIELD_OF_VIEW / 16;
+/** Size of a person's head & shoulders, along and across the walking direction */
+static const float BODY_DEPTH = 300;
+static const float BODY_WIDTH = 450;
+/** Distance from the doorway at which people start and stop walking */
+static const int32_t WALKING_DISTANCE = 1500;
+/** Quiet time at the end of a scenario, so the last crossing can complete */
+static const uint32_t TAIL_MS = 1500;
+/** Distance from the sensor to the bottom of the door frame */
+static const float FRAME_DEPTH = 300;
+
+int32_t Person::x_at(uint32_t time_ms) const {
+  if (time_ms <= start_ms) {
+    return start_x;
+  }
+  float elapsed = time_ms - start_ms;
+  float to_center = std::abs(start_x) / speed;
+  if (elapsed < to_center) {
+    return start_x + (start_x < 0 ? 1 : -1) * elapsed * speed;
+  }
+  elapsed -= to_center + stop_ms;
+  if (elapsed < 0) {
+    return 0;
+  }
+  int32_t target = turns_back ? start_x : end_x;
+  float to_target = std::abs(target) / speed;
+  if (elapsed < to_target) {
+    return (target < 0 ? -1 : 1) * elapsed * speed;
+  }
+  return target;
+}
+
+uint32_t Person::crossed_at() const { return start_ms + std::abs(start_x) / speed + stop_ms; }
+
+uint32_t Person::finished_at() const {
+  int32_t target = turns_back ? start_x : end_x;
+  return start_ms + (std::abs(start_x) + std::abs(target)) / speed + stop_ms;
+}
+
+Scenario generate_scenario(const ScenarioParameters &parameters, uint32_t seed) {
+  std::mt19937 random(seed);
+  auto uniform = [&random](float min, float max) { return std::uniform_real_distribution<float>(min, max)(random); };
+  auto chance = [&uniform](float probability) { return uniform(0, 1) < probability; };
+
+  Scenario scenario{};
+  int direction = chance(0.5f) ? 1 : -1;
+  uint8_t group_size = 1;
+  if (parameters.max_group_size > 1 && chance(parameters.group_probability)) {
+    group_size = std::uniform_int_distribution<int>(2, parameters.max_group_size)(random);
+  }
+
+  uint32_t start_ms = 500;
+  for (uint8_t i = 0; i < group_size; i++) {
+    Person person{};
+    person.start_x = -direction * WALKING_DISTANCE;
+    person.end_x = direction * WALKING_DISTANCE;
+    person.speed = uniform(parameters.min_speed, parameters.max_speed);
+    person.height = uniform(parameters.min_height, parameters.max_height);
+    person.lateral_offset = uniform(-parameters.max_lateral_offset, parameters.max_lateral_offset);
+    person.start_ms = start_ms;
+    person.stop_ms = chance(parameters.stop_probability) ? uniform(0, parameters.max_stop_ms) : 0;
+    person.turns_back = chance(parameters.turn_back_probability);
+    // Keep the spacing to the person in front, even if they stop
+    start_ms += person.stop_ms + uniform(parameters.min_group_spacing, parameters.max_group_spacing) / person.speed;
+
+    if (!person.turns_back) {
+      scenario.expected_delta -= direction;
+    }
+    scenario.duration_ms = std::max(scenario.duration_ms, person.finished_at() + TAIL_MS);
+    scenario.people.push_back(person);
+  }
+
+  if (chance(parameters.pet_probability)) {
+    int pet_direction = chance(0.5f) ? 1 : -1;
+    Person pet{};
+    pet.start_x = -pet_direction * WALKING_DISTANCE;
+    pet.end_x = pet_direction * WALKING_DISTANCE;
+    pet.speed = uniform(parameters.min_speed, 2 * parameters.max_speed);
+    pet.height = uniform(parameters.min_pet_height, parameters.max_pet_height);
+    pet.lateral_offset = uniform(-parameters.max_lateral_offset, parameters.max_lateral_offset);
+    pet.start_ms = uniform(0, start_ms);
+    pet.is_pet = true;
+    scenario.duration_ms = std::max(scenario.duration_ms, pet.finished_at() + TAIL_MS);
+    scenario.people.push_back(pet);
+  }
+  return scenario;
+}
+
+Scene::Scene(const Scenario &scenario, uint16_t mounting_height, esphome::roode::Orientation orientation,
+             uint32_t seed)
+    : scenario_(scenario), mounting_height_(mounting_height), orientation_(orientation), random_(seed) {}
+
+/** Angles of the ROI along (x) and across (y) the walking direction, relative to the optical axis */
+struct Extent {
+  float from;
+  float to;
+  float overlap(float a, float b) const { return std::max(0.0f, std::min(to, b) - std::max(from, a)); }
+  float size() const { return to - from; }
+};
+
+uint16_t Scene::measure(const RangingContext &context) {
+  // See the SPAD table in the README: the upper half is numbered by column from 128, the lower half from 127 down
+  uint8_t center = context.roi_center;
+  uint8_t column = center >= 128 ? (center - 128) / 8 : (127 - center) / 8;
+  uint8_t row = center >= 128 ? (center - 128) % 8 : 8 + (127 - center) % 8;
+  // The center SPAD is the one above and to the right of the exact center of the ROI
+  auto columns = [](uint8_t middle, uint16_t size) {
+    float start = middle - size / 2;
+    return Extent{(start - 8) * SPAD_ANGLE, (start + size - 8) * SPAD_ANGLE};
+  };
+  auto rows = [](uint8_t middle, uint16_t size) {
+    float start = middle - (size - 1) / 2;
+    return Extent{(start - 8) * SPAD_ANGLE, (start + size - 8) * SPAD_ANGLE};
+  };
+  bool parallel = this->orientation_ == esphome::roode::Parallel;
+  Extent along = parallel ? columns(column, context.roi_width) : rows(row, context.roi_height);
+  Extent across = parallel ? rows(row, context.roi_height) : columns(column, context.roi_width);
+
+  // Blend all targets in the ROI by their signal strength, which is proportional to coverage and 1/d^2
+  float floor = this->mounting_height_;
+  float covered = 0;
+  float weighted_distance = 0;
+  float total_weight = 0;
+
+  // The background is the floor, unless part of the ROI looks at the door frame
+  if (this->frame_offset_ > 0) {
+    float frame_angle = -std::atan(this->frame_offset_ / FRAME_DEPTH);
+    float on_frame = along.overlap(-FIELD_OF_VIEW, frame_angle) / along.size();
+    float weight = on_frame / (FRAME_DEPTH * FRAME_DEPTH);
+    covered += on_frame;
+    weighted_distance += weight * FRAME_DEPTH;
+    total_weight += weight;
+  }
+  if (context.time_us >= this->origin_us_) {
+    uint32_t time_ms = (context.time_us - this->origin_us_) / 1000;
+    for (const auto &person : this->scenario_.people) {
+      float distance = std::max(50.0f, floor - person.height);
+      float x = person.x_at(time_ms);
+      float y = person.lateral_offset;
+      float coverage = along.overlap(std::atan((x - BODY_DEPTH / 2) / distance),
+                                     std::atan((x + BODY_DEPTH / 2) / distance)) /
+                       along.size() *
+                       across.overlap(std::atan((y - BODY_WIDTH / 2) / distance),
+                                      std::atan((y + BODY_WIDTH / 2) / distance)) /
+                       across.size();
+      if (coverage <= 0) {
+        continue;
+      }
+      float weight = coverage / (distance * distance);
+      covered += coverage;
+      weighted_distance += weight * distance;
+      total_weight += weight;
+    }
+  }
+  float floor_weight = std::max(0.0f, 1 - covered) / (floor * floor);
+  weighted_distance += floor_weight * floor;
+  total_weight += floor_weight;
+
+  float distance = weighted_distance / total_weight;
+  distance += this->noise(distance, context);
+  return std::max(0.0f, distance);
+}
+
+/**
+ * Measurement noise, roughly following the datasheet: the standard deviation grows with distance and shrinks with the
+ * square root of the timing budget. Short distance mode is only good up to 1.3m.
+ */
+float Scene::noise(uint16_t distance, const RangingContext &context) {
+  float sd = (2 + 4 * distance / 1000.0f) * std::sqrt(100.0f / context.timing_budget);
+  if (context.distance_mode == Short && distance > 1300) {
+    sd *= 4;
+  }
+  return std::normal_distribution<float>(0, sd)(this->random_);
+}
+
+}  // namespace simulator
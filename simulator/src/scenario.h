@@ -0,0 +1,95 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include "VL53L1X_ULD.h"
+#include "roode/orientation.h"
+
+namespace simulator {
+
+/**
+ * A person walking through the doorway along the x axis. Positions are in mm, 0 is right below the sensor.
+ * The entry zone covers negative x, so walking towards positive x passes the entry zone first, which
+ * Roode::path_tracking counts as an exit.
+ */
+struct Person {
+  int32_t start_x;
+  int32_t end_x;
+  /** Walking speed in mm/ms, which is the same as m/s */
+  float speed;
+  /** Height of the top of the head in mm */
+  uint16_t height;
+  /** Offset from the center of the doorway, perpendicular to the walking direction, in mm */
+  int16_t lateral_offset;
+  /** When the person starts walking, relative to the start of the scenario */
+  uint32_t start_ms;
+  /** How long the person stands still right below the sensor */
+  uint32_t stop_ms;
+  /** Whether the person turns around below the sensor and walks back */
+  bool turns_back;
+  /** A pet walking through, which shouldn't be counted */
+  bool is_pet;
+
+  int32_t x_at(uint32_t time_ms) const;
+  /** When the person is right below the sensor and starts walking on */
+  uint32_t crossed_at() const;
+  uint32_t finished_at() const;
+};
+
+struct Scenario {
+  std::vector<Person> people;
+  /** People counter change Roode should report */
+  int expected_delta;
+  uint32_t duration_ms;
+};
+
+/** Ranges the random scenarios are drawn from */
+struct ScenarioParameters {
+  float min_speed = 0.5f;
+  float max_speed = 1.8f;
+  uint16_t min_height = 1500;
+  uint16_t max_height = 1950;
+  int16_t max_lateral_offset = 300;
+  uint8_t max_group_size = 3;
+  float group_probability = 0.3f;
+  uint16_t min_group_spacing = 600;
+  uint16_t max_group_spacing = 1500;
+  float stop_probability = 0.2f;
+  uint32_t max_stop_ms = 3000;
+  float turn_back_probability = 0.0f;
+  /** Chance a pet walks through as well, at some point during the scenario */
+  float pet_probability = 0.0f;
+  uint16_t min_pet_height = 250;
+  uint16_t max_pet_height = 600;
+};
+
+Scenario generate_scenario(const ScenarioParameters &parameters, uint32_t seed);
+
+/** Turns the people of a scenario into the distances the sensor would measure for a given ROI. */
+class Scene {
+ public:
+  Scene(const Scenario &scenario, uint16_t mounting_height, esphome::roode::Orientation orientation, uint32_t seed);
+  /**
+   * Puts the door frame on the entry side in view, for a sensor mounted off-center.
+   * The frame is FRAME_DEPTH below the sensor and starts the given distance from the optical center.
+   */
+  void set_frame_offset(uint16_t frame_offset) { this->frame_offset_ = frame_offset; }
+  /** The scenario starts at this point in simulated time, before that the doorway is empty */
+  void set_origin(uint64_t time_us) { this->origin_us_ = time_us; }
+  uint16_t measure(const RangingContext &context);
+
+ protected:
+  float noise(uint16_t distance, const RangingContext &context);
+
+  const Scenario &scenario_;
+  uint16_t mounting_height_;
+  uint16_t frame_offset_{0};
+  esphome::roode::Orientation orientation_;
+  /** Set by the main thread while the acquisition task may already be measuring */
+  std::atomic<uint64_t> origin_us_{UINT64_MAX};
+  std::mt19937 random_;
+};
+
+}  // namespace simulator